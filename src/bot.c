@@ -0,0 +1,239 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "bot.h"
+#include "memory.h"
+#include "input.h"
+#include "core.h"
+
+#define BOT_POLL_NS 20'000 // while waiting for the agent in step mode
+#define BOT_IDLE_NS 1'000'000 // once it has been thinking for BOT_SPIN_NS
+#define BOT_SPIN_NS 2'000'000
+#define BOT_AGENT_TIMEOUT_NS (10 * 1'000'000'000ull) // without a step nor a heartbeat, the agent is gone
+#define BOT_SHM_NAME_LEN 64
+
+struct bot_s {
+    bool active;
+    uint8_t buttons;
+    uint32_t frames_left; // 0 for until changed
+
+    struct bot_shm_s *shm;
+    char shm_name[BOT_SHM_NAME_LEN];
+    bool step;
+    uint32_t command; // last one applied
+    bool lost; // the agent stopped answering in step mode
+
+    struct cartridge_s *cartridge; // when embedded
+    uint64_t frame;
+};
+
+static struct bot_s bot;
+
+void bot_views(struct bot_views_s *views) {
+    views->wram = memory_special_get_wram();
+    views->hram = memory_special_get_hram();
+    views->oam = memory_special_get_oam_area();
+    views->framebuffer = ppu_get_framebuffer();
+}
+
+void bot_set_buttons(uint8_t buttons, uint32_t frames) {
+    bot.active = true;
+    bot.buttons = buttons;
+    bot.frames_left = frames;
+}
+
+void bot_release() {
+    bot.active = false;
+}
+
+/* false when the agent neither allowed the frame nor beat for BOT_AGENT_TIMEOUT_NS */
+static bool bot_wait_step(uint64_t frame) {
+    const uint64_t start = SDL_GetTicksNS();
+    uint64_t last_sign = start;
+    uint64_t heartbeat = atomic_load_explicit(&bot.shm->heartbeat, memory_order_relaxed);
+
+    while (atomic_load_explicit(&bot.shm->step, memory_order_acquire) <= frame) {
+        const uint64_t now = SDL_GetTicksNS();
+        const uint64_t beat = atomic_load_explicit(&bot.shm->heartbeat, memory_order_relaxed);
+        if (beat != heartbeat) {
+            heartbeat = beat;
+            last_sign = now;
+        } else if (now - last_sign >= BOT_AGENT_TIMEOUT_NS)
+            return false;
+
+        SDL_DelayNS(now - start < BOT_SPIN_NS ? BOT_POLL_NS : BOT_IDLE_NS);
+    }
+
+    return true;
+}
+
+uint8_t bot_buttons(uint64_t frame, uint8_t host) {
+    if (bot.shm) {
+        if (bot.step && !bot_wait_step(frame)) {
+            LOG_MESG(LOG_WARN, "The bot agent didn't step frame %"PRIu64" nor beat for %llu s, it is considered gone", frame, BOT_AGENT_TIMEOUT_NS / 1'000'000'000ull);
+            bot.step = false;
+            bot.lost = true;
+        }
+
+        const uint32_t command = atomic_load_explicit(&bot.shm->command, memory_order_acquire);
+        if (command != bot.command) {
+            bot.command = command;
+            bot_set_buttons(bot.shm->buttons, bot.shm->frames);
+        }
+    }
+
+    if (!bot.active)
+        return host;
+
+    const uint8_t buttons = bot.buttons;
+    if (bot.frames_left && !--bot.frames_left)
+        bot.active = false;
+    return buttons;
+}
+
+bool bot_open(char *rom_path) {
+    bot_close();
+
+    bot.cartridge = cartridge_load(rom_path);
+    if (!bot.cartridge) {
+        LOG_MESG(LOG_WARN, "Couldn't load cartridge %s", rom_path);
+        return false;
+    }
+
+    core_reset(bot.cartridge);
+    ppu_init(); // renders on this thread when it couldn't start its own
+
+    bot.frame = 0;
+    return true;
+}
+
+bool bot_step_frame() {
+    if (!bot.cartridge)
+        return false;
+
+    /* no host buttons, and no console to prompt the debugger on: run as a speculative frame,
+     * which only leaves the statistics out besides */
+    input_set_buttons(bot_buttons(bot.frame, 0));
+    const bool ran = core_run_frame(true, true);
+    ppu_render_wait();
+    if (ran)
+        bot.frame++;
+    return ran;
+}
+
+void bot_close() {
+    if (!bot.cartridge)
+        return;
+
+    ppu_shutdown();
+    cartridge_unload(bot.cartridge);
+    bot.cartridge = NULL;
+}
+
+bool bot_shm_is_active() {
+    return bot.shm;
+}
+
+bool bot_agent_lost() {
+    return bot.lost;
+}
+
+#ifdef _WIN32
+
+bool bot_shm_start(const char *name, bool step) {
+    (void)name;
+    (void)step;
+    LOG_MESG(LOG_WARN, "The bot shared memory is not supported on Windows yet");
+    return false;
+}
+
+void bot_shm_stop() {
+}
+
+void bot_shm_publish(uint64_t frames) {
+    (void)frames;
+}
+
+#else
+
+bool bot_shm_start(const char *name, bool step) {
+    if (strlen(name) >= BOT_SHM_NAME_LEN) {
+        LOG_MESG(LOG_WARN, "Shared memory name %s is too long", name);
+        return false;
+    }
+
+    const int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        LOG_MESG(LOG_WARN, "Couldn't open shared memory %s", name);
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(struct bot_shm_s))) {
+        LOG_MESG(LOG_WARN, "Couldn't size shared memory %s", name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *shm = mmap(NULL, sizeof(struct bot_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        LOG_MESG(LOG_WARN, "Couldn't map shared memory %s", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    bot.shm = shm;
+    memset(bot.shm, 0, sizeof(struct bot_shm_s));
+    memcpy(bot.shm->magic, BOT_SHM_MAGIC, sizeof(bot.shm->magic));
+    bot.shm->version = BOT_SHM_VERSION;
+    strcpy(bot.shm_name, name);
+    bot.step = step;
+    bot.command = 0;
+    bot.lost = false;
+
+    LOG_MESG(LOG_INFO, "Bot control block shared as %s%s", name, step ? ", the agent steps the frames" : "");
+    return true;
+}
+
+void bot_shm_stop() {
+    if (!bot.shm)
+        return;
+
+    munmap(bot.shm, sizeof(struct bot_shm_s));
+    shm_unlink(bot.shm_name);
+    bot.shm = NULL;
+}
+
+void bot_shm_publish(uint64_t frames) {
+    if (!bot.shm)
+        return;
+
+    // a seqlock: the agent copies the views and retries when `seq` was odd or changed meanwhile
+    struct bot_shm_s *shm = bot.shm;
+    const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(shm->wram, memory_special_get_wram(), BOT_WRAM_SIZE);
+    memcpy(shm->hram, memory_special_get_hram(), BOT_HRAM_SIZE);
+    memcpy(shm->oam, memory_special_get_oam_area(), BOT_OAM_SIZE);
+    memcpy(shm->framebuffer, ppu_get_framebuffer(), sizeof(shm->framebuffer));
+
+    atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&shm->frame, frames, memory_order_release);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef BOT
+#define BOT
+
+#include <inttypes.h>
+#include <stdatomic.h>
+
+#include "ppu.h"
+
+/* Drives the guest from a program instead of the keyboard: buttons for the coming frames,
+ * and read only views of the game. In process the views point at the emulator's own memory,
+ * another process gets the same through a shared memory control block. */
+
+#define BOT_WRAM_SIZE 0x2000 // 0xC000-0xDFFF
+#define BOT_HRAM_SIZE 0x7F // 0xFF80-0xFFFE
+#define BOT_OAM_SIZE 0xA0 // 0xFE00-0xFE9F
+
+struct bot_views_s {
+    const uint8_t *wram;
+    const uint8_t *hram;
+    const uint8_t *oam;
+    const uint32_t *framebuffer; // see ppu_get_framebuffer(), complete once ppu_render_wait() returned
+};
+
+void bot_views(struct bot_views_s *views);
+/* INPUT_BUTTON_* bits replacing the host's for the next `frames` frames, 0 for until called again */
+void bot_set_buttons(uint8_t buttons, uint32_t frames);
+/* give the buttons back to the host */
+void bot_release();
+
+/* once per frame before it is emulated: the buttons the guest gets, waiting for the agent in step mode */
+uint8_t bot_buttons(uint64_t frame, uint8_t host);
+
+/* An embedding process runs the emulator through these instead of main(), after log_init():
+ * bot_step_frame() emulates one frame with the buttons set above, the views are complete once it returns */
+bool bot_open(char *rom_path);
+bool bot_step_frame();
+void bot_close();
+
+#define BOT_SHM_MAGIC "VGEB"
+#define BOT_SHM_VERSION 2
+
+/* Layout of the shared memory object. The emulator publishes every frame: it makes `seq` odd,
+ * copies the views, makes `seq` even again and then sets `frame` to the number of frames run.
+ * The agent sets `buttons` and `frames` (as bot_set_buttons()) then increments `command`.
+ * In step mode the emulator only runs frame n once the agent set `step` above n. An agent thinking
+ * longer than 10 s on a frame increments `heartbeat` meanwhile, or the emulator stops waiting and quits. */
+struct bot_shm_s {
+    char magic[4];
+    uint32_t version;
+
+    _Atomic uint64_t frame;
+    _Atomic uint32_t seq;
+    uint8_t wram[BOT_WRAM_SIZE];
+    uint8_t hram[BOT_HRAM_SIZE];
+    uint8_t oam[BOT_OAM_SIZE];
+    uint32_t framebuffer[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+
+    _Atomic uint32_t command;
+    uint8_t buttons;
+    uint32_t frames;
+    _Atomic uint64_t step;
+    _Atomic uint64_t heartbeat;
+};
+
+/* `name` as given to shm_open(), "/vge" for instance */
+bool bot_shm_start(const char *name, bool step);
+void bot_shm_stop();
+bool bot_shm_is_active();
+/* the agent stopped answering in step mode, the run should end */
+bool bot_agent_lost();
+/* once per frame after it was drawn, `frames` being the number of frames run */
+void bot_shm_publish(uint64_t frames);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "capture.h"
+#include "ppu.h"
+
+#define CAPTURE_QUEUE_SIZE 64 // about a second of distinct frames
+#define CAPTURE_PIXELS (PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT)
+#define CAPTURE_FRAME_RATE "4194304:70224" // one frame every 70224 clocks
+#define CAPTURE_STALL_NS (1 * 1'000'000)
+
+enum capture_format_e: uint8_t {
+    CAPTURE_FORMAT_RAW,
+    CAPTURE_FORMAT_Y4M
+};
+
+/* a new frame, or a marker repeating the previous one, which copies nothing */
+struct capture_slot_s {
+    uint32_t repeats;
+    uint32_t pixels[CAPTURE_PIXELS];
+};
+
+/* single producer single consumer ring: the emulation thread fills the slot at `head`,
+ * the writer thread empties the one at `tail`, neither ever takes a lock */
+struct capture_s {
+    FILE *f;
+    enum capture_format_e format;
+    SDL_Thread *thread;
+    SDL_Semaphore *queued; // one count per pushed slot, plus a last one to quit
+
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    /* emulation thread only */
+    const uint32_t *last; // pixels of the last frame pushed
+    uint32_t pending_repeats;
+    uint64_t frames, stalls;
+
+    /* writer thread only */
+    bool failed;
+    uint8_t out[CAPTURE_PIXELS * 4]; // the last frame, converted
+
+    struct capture_slot_s slots[CAPTURE_QUEUE_SIZE];
+};
+
+static struct capture_s *capture = NULL;
+
+static void capture_convert(const uint32_t *pixels) {
+    if (capture->format == CAPTURE_FORMAT_RAW) {
+        for (size_t i = 0; i < CAPTURE_PIXELS; i++) {
+            capture->out[i * 4] = pixels[i] >> 16;
+            capture->out[i * 4 + 1] = pixels[i] >> 8;
+            capture->out[i * 4 + 2] = pixels[i];
+            capture->out[i * 4 + 3] = pixels[i] >> 24;
+        }
+        return;
+    }
+
+    // planar 4:4:4, BT.601 limited range
+    uint8_t *y = capture->out, *u = y + CAPTURE_PIXELS, *v = u + CAPTURE_PIXELS;
+    for (size_t i = 0; i < CAPTURE_PIXELS; i++) {
+        const int32_t r = (pixels[i] >> 16) & 0xFF, g = (pixels[i] >> 8) & 0xFF, b = pixels[i] & 0xFF;
+        y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+static void capture_write() {
+    if (capture->failed)
+        return;
+
+    const size_t size = capture->format == CAPTURE_FORMAT_RAW ? CAPTURE_PIXELS * 4 : CAPTURE_PIXELS * 3;
+    if ((capture->format == CAPTURE_FORMAT_Y4M && fputs("FRAME\n", capture->f) == EOF) || fwrite(capture->out, size, 1, capture->f) != 1) {
+        LOG_MESG(LOG_WARN, "Couldn't write the capture, the rest of it is lost");
+        capture->failed = true;
+    }
+}
+
+static int capture_thread(void *data) {
+    (void)data;
+
+    while (true) {
+        SDL_WaitSemaphore(capture->queued);
+
+        const size_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&capture->head, memory_order_acquire))
+            break; // only the count to quit was left
+
+        const struct capture_slot_s *slot = &capture->slots[tail % CAPTURE_QUEUE_SIZE];
+        if (slot->repeats) {
+            for (uint32_t i = 0; i < slot->repeats; i++)
+                capture_write();
+        } else {
+            capture_convert(slot->pixels);
+            capture_write();
+        }
+
+        atomic_store_explicit(&capture->tail, tail + 1, memory_order_release);
+    }
+
+    return 0;
+}
+
+/* the next free slot, waiting for the writer only when it is a whole queue behind */
+static struct capture_slot_s *capture_slot() {
+    const size_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&capture->tail, memory_order_acquire) == CAPTURE_QUEUE_SIZE) {
+        if (!capture->stalls++)
+            LOG_MESG(LOG_WARN, "The capture can't be written fast enough, the emulation waits for it");
+        while (head - atomic_load_explicit(&capture->tail, memory_order_acquire) == CAPTURE_QUEUE_SIZE)
+            SDL_DelayNS(CAPTURE_STALL_NS);
+    }
+
+    return &capture->slots[head % CAPTURE_QUEUE_SIZE];
+}
+
+static void capture_push() {
+    atomic_store_explicit(&capture->head, atomic_load_explicit(&capture->head, memory_order_relaxed) + 1, memory_order_release);
+    SDL_SignalSemaphore(capture->queued);
+}
+
+static void capture_flush_repeats() {
+    if (!capture->pending_repeats)
+        return;
+
+    capture_slot()->repeats = capture->pending_repeats;
+    capture_push();
+    capture->pending_repeats = 0;
+}
+
+bool capture_start(const char *path) {
+    capture = calloc(1, sizeof(struct capture_s));
+    if (!capture) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    const size_t len = strlen(path);
+    capture->format = len >= 4 && !strcmp(path + len - 4, ".y4m") ? CAPTURE_FORMAT_Y4M : CAPTURE_FORMAT_RAW;
+
+    capture->f = fopen(path, "wb");
+    if (!capture->f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        free(capture);
+        capture = NULL;
+        return false;
+    }
+
+    if (capture->format == CAPTURE_FORMAT_Y4M && fprintf(capture->f, "YUV4MPEG2 W%d H%d F"CAPTURE_FRAME_RATE" Ip A1:1 C444\n", PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT) < 0) {
+        LOG_MESG(LOG_WARN, "Couldn't write the y4m header to %s", path);
+        capture_stop();
+        return false;
+    }
+
+    capture->queued = SDL_CreateSemaphore(0);
+    if (capture->queued)
+        capture->thread = SDL_CreateThread(capture_thread, "capture", NULL);
+    if (!capture->thread) {
+        LOG_MESG(LOG_WARN, "Couldn't start the capture thread: %s", SDL_GetError());
+        capture_stop();
+        return false;
+    }
+
+    if (capture->format == CAPTURE_FORMAT_Y4M)
+        LOG_MESG(LOG_INFO, "Capturing to %s", path);
+    else
+        LOG_MESG(LOG_INFO, "Capturing to %s as raw rgba, %dx%d at "CAPTURE_FRAME_RATE" fps", path, PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT);
+    return true;
+}
+
+void capture_stop() {
+    if (!capture)
+        return;
+
+    if (capture->thread) {
+        capture_flush_repeats();
+        SDL_SignalSemaphore(capture->queued);
+        SDL_WaitThread(capture->thread, NULL);
+        LOG_MESG(LOG_INFO, "Captured %"PRIu64" frames, the emulation waited for the writer %"PRIu64" times", capture->frames, capture->stalls);
+    }
+
+    if (capture->queued)
+        SDL_DestroySemaphore(capture->queued);
+    fclose(capture->f);
+    free(capture);
+    capture = NULL;
+}
+
+bool capture_is_active() {
+    return capture;
+}
+
+uint32_t capture_backlog() {
+    if (!capture)
+        return 0;
+    return atomic_load_explicit(&capture->head, memory_order_relaxed) - atomic_load_explicit(&capture->tail, memory_order_relaxed);
+}
+
+void capture_frame(const uint32_t *framebuffer) {
+    if (!capture)
+        return;
+
+    if (!capture->last && !framebuffer)
+        return; // nothing was shown yet
+
+    capture->frames++;
+    if (capture->last && (!framebuffer || !memcmp(framebuffer, capture->last, sizeof(capture->slots[0].pixels)))) {
+        capture->pending_repeats++;
+        return;
+    }
+
+    capture_flush_repeats();
+    struct capture_slot_s *slot = capture_slot();
+    slot->repeats = 0;
+    memcpy(slot->pixels, framebuffer, sizeof(slot->pixels));
+    capture->last = slot->pixels;
+    capture_push();
+}
\ No newline at end of file
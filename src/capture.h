@@ -0,0 +1,16 @@
+#ifndef CAPTURE
+#define CAPTURE
+
+#include <inttypes.h>
+
+/* stream the shown frames uncompressed, as y4m when `path` ends with .y4m, raw RGBA otherwise */
+bool capture_start(const char *path);
+void capture_stop();
+
+bool capture_is_active();
+/* slots queued and not written yet */
+uint32_t capture_backlog();
+/* called once per emulated frame with the frame on screen, NULL when it didn't change */
+void capture_frame(const uint32_t *framebuffer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+
+#include "log.h"
+
+#include "core.h"
+#include "memory.h"
+#include "cpu.h"
+#include "cpu_debug.h"
+#include "interrupt.h"
+#include "ppu.h"
+
+static uint8_t m_cycles_to_add = 0;
+static uint64_t m_cycles_total = 0, instruction_executed = 0;
+
+void core_reset(struct cartridge_s *cartridge) {
+    memory_reset();
+    memory_cartridge_load(cartridge);
+    cpu_init();
+    cpu_reset();
+    interrupt_reset();
+}
+
+bool core_run_frame(bool render, bool speculative) {
+    uint8_t m_cycles;
+    do {
+        if (!speculative && !cpu_debug_run())
+            return false;
+        m_cycles = cpu_execute();
+        m_cycles += m_cycles_to_add;
+        m_cycles_to_add = 0;
+        if (!m_cycles) {
+            LOG_MESG(LOG_FATAL, "cpu failed to execute!");
+            LOG_MESG(LOG_FATAL, "m cycles elapsed: %"PRIu64", instructions executed: %"PRIu64"", m_cycles_total, instruction_executed);
+            exit(EXIT_FAILURE);
+        }
+        if (!speculative) {
+            m_cycles_total += m_cycles;
+            instruction_executed++;
+        }
+        interrupt_run(m_cycles);
+    } while (!ppu_run(m_cycles, render));
+
+    return true;
+}
+
+void core_add_m_cycles(uint8_t m_cycles) {
+    m_cycles_to_add = m_cycles;
+}
+
+uint64_t core_m_cycles() {
+    return m_cycles_total;
+}
+
+uint64_t core_instructions() {
+    return instruction_executed;
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef CORE
+#define CORE
+
+#include <inttypes.h>
+
+#include "cartridge.h"
+
+/* reset the emulated hardware, with `cartridge` inserted */
+void core_reset(struct cartridge_s *cartridge);
+
+/* run the core until the ppu completes a frame, into the ppu framebuffer when `render`.
+ * Speculative frames are thrown away afterward: they skip the debugger and the statistics */
+bool core_run_frame(bool render, bool speculative);
+
+/* extra cycles the instruction being executed took, an OAM DMA for instance */
+void core_add_m_cycles(uint8_t m_cycles);
+
+uint64_t core_m_cycles();
+uint64_t core_instructions();
+
+#endif
\ No newline at end of file
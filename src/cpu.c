@@ -1,10 +1,12 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "log.h"
 
 #include "cpu.h"
 #include "interrupt.h"
+#include "prof.h"
 
 #define FLAGS_Z 0b1000'0000
 #define FLAGS_N 0b0100'0000
@@ -67,12 +69,19 @@ struct cpu_s cpu;
 FILE *f = NULL;
 
 static void cpu_destroy() {
-    fclose(f);
+    if (f)
+        fclose(f);
 }
 
+/* once per process, cpu_reset() can be called again afterward */
 void cpu_init() {
+    static bool initialized = false;
+    if (initialized)
+        return;
+
+    f = fopen("./debug.txt", "w");
     atexit(cpu_destroy);
-    cpu_reset();
+    initialized = true;
 }
 
 void cpu_reset() {
@@ -86,8 +95,6 @@ void cpu_reset() {
     cpu.registers.l = 0x4D;
     cpu.registers.sp = 0xFFFE;
     cpu.registers.pc = 0x100;
-
-    f = fopen("./debug.txt", "w");
 }
 
 void cpu_interrupt(uint16_t addr) {
@@ -345,6 +352,18 @@ uint16_t cpu_get_pc() {
     return cpu.registers.pc;
 }
 
+size_t cpu_state_size() {
+    return sizeof(struct cpu_s);
+}
+
+void cpu_state_save(uint8_t *buffer) {
+    memcpy(buffer, &cpu, sizeof(struct cpu_s));
+}
+
+void cpu_state_load(const uint8_t *buffer) {
+    memcpy(&cpu, buffer, sizeof(struct cpu_s));
+}
+
 static uint8_t cpu_execute_prefix_cb() {
     uint8_t instr = memory_read_8(cpu.registers.pc);
     cpu.registers.pc++;
@@ -371,6 +390,8 @@ static uint8_t cpu_execute_prefix_cb() {
 }
 
 uint8_t cpu_execute() {
+    PROF_SCOPE(PROF_CPU);
+
     fprintf(
         f,
         "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
@@ -2,6 +2,7 @@
 #define CPU
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "memory.h"
 
@@ -16,4 +17,8 @@ void cpu_print_registers();
 void cpu_print_next_instr();
 uint16_t cpu_get_pc();
 
+size_t cpu_state_size();
+void cpu_state_save(uint8_t *buffer);
+void cpu_state_load(const uint8_t *buffer);
+
 #endif
\ No newline at end of file
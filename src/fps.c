@@ -1,12 +1,14 @@
 #include <SDL3/SDL.h>
 
-#include "log.h"
-
 #include "fps.h"
+#include "prof.h"
 
 uint64_t ns_last = 0;
+uint64_t ns_slept = 0;
 
 void fps_wait(uint64_t wait_ns) {
+    PROF_SCOPE(PROF_SLEEP);
+
     const uint64_t current_ns = SDL_GetTicksNS();
     const uint64_t ellapsed_ns = current_ns - ns_last;
 
@@ -17,6 +19,14 @@ void fps_wait(uint64_t wait_ns) {
 
 end_func:
     const uint64_t after_ellapsed_ns = SDL_GetTicksNS();
-    LOG_MESG(LOG_DEBUG, "ellapsed ms: %5.2f", ((double)(after_ellapsed_ns - ns_last)) / 1'000'000.0);
+    ns_slept += after_ellapsed_ns - current_ns;
     ns_last = after_ellapsed_ns;
+}
+
+uint64_t fps_slept_ns() {
+    return ns_slept;
+}
+
+bool fps_due(uint64_t wait_ns) {
+    return SDL_GetTicksNS() - ns_last >= wait_ns;
 }
\ No newline at end of file
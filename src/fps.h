@@ -2,5 +2,9 @@
 #define FPS
 
 void fps_wait(uint64_t wait_ns);
+/* true once `wait_ns` went by since the last fps_wait() */
+bool fps_due(uint64_t wait_ns);
+/* total time fps_wait() spent sleeping */
+uint64_t fps_slept_ns();
 
 #endif
\ No newline at end of file
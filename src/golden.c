@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "golden.h"
+#include "hash.h"
+#include "ppu.h"
+
+struct golden_frame_s {
+    uint64_t frame;
+    uint64_t hash;
+};
+
+struct golden_s {
+    FILE *out;
+
+    /* both sorted by frame, `next` being the first golden frame not compared yet */
+    struct golden_frame_s *frames;
+    size_t count, next;
+    uint64_t *selected;
+    size_t selected_count, selected_next;
+    bool select_all, has_selection;
+    bool diverged;
+};
+
+static struct golden_s golden;
+
+bool golden_record_start(const char *path) {
+    golden.out = fopen(path, "w");
+    if (!golden.out) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        return false;
+    }
+
+    LOG_MESG(LOG_INFO, "Writing framebuffer hashes to %s", path);
+    return true;
+}
+
+bool golden_compare_start(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        return false;
+    }
+
+    size_t capacity = 0;
+    struct golden_frame_s entry;
+    int read;
+    while ((read = fscanf(f, "%"SCNu64" %"SCNx64, &entry.frame, &entry.hash)) == 2) {
+        if (golden.count && entry.frame <= golden.frames[golden.count - 1].frame) {
+            LOG_MESG(LOG_WARN, "Frames of %s are not in increasing order (frame %"PRIu64")", path, entry.frame);
+            fclose(f);
+            return false;
+        }
+
+        if (golden.count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            struct golden_frame_s *frames = realloc(golden.frames, capacity * sizeof(*frames));
+            if (!frames) {
+                LOG_MESG(LOG_WARN, "Couldn't malloc");
+                fclose(f);
+                return false;
+            }
+            golden.frames = frames;
+        }
+        golden.frames[golden.count++] = entry;
+    }
+    fclose(f);
+
+    if (read != EOF || !golden.count) {
+        LOG_MESG(LOG_WARN, "%s is not a framebuffer hash file", path);
+        return false;
+    }
+
+    LOG_MESG(LOG_INFO, "Comparing %zu frames against %s", golden.count, path);
+    return true;
+}
+
+bool golden_select(const char *frames) {
+    golden.has_selection = true;
+    if (!strcmp(frames, "all")) {
+        golden.select_all = true;
+        return true;
+    }
+
+    const char *p = frames;
+    while (*p) {
+        char *end;
+        const uint64_t frame = strtoull(p, &end, 10);
+        if (end == p || (*end && *end != ',') || (golden.selected_count && frame <= golden.selected[golden.selected_count - 1])) {
+            LOG_MESG(LOG_WARN, "Frames must be \"all\" or increasing numbers separated by commas: %s", frames);
+            return false;
+        }
+
+        uint64_t *selected = realloc(golden.selected, (golden.selected_count + 1) * sizeof(*selected));
+        if (!selected) {
+            LOG_MESG(LOG_WARN, "Couldn't malloc");
+            return false;
+        }
+        golden.selected = selected;
+        golden.selected[golden.selected_count++] = frame;
+
+        p = *end ? end + 1 : end;
+    }
+
+    return golden.selected_count;
+}
+
+bool golden_stop(uint64_t frames) {
+    bool complete = !golden.diverged;
+    while (golden.next < golden.count && golden.frames[golden.next].frame < frames)
+        golden.next++; // not selected
+    if (complete && golden.next < golden.count) {
+        LOG_MESG(LOG_WARN, "The run stopped after %"PRIu64" frames, before golden frame %"PRIu64"", frames, golden.frames[golden.next].frame);
+        complete = false;
+    } else if (complete && golden.count)
+        LOG_MESG(LOG_INFO, "The %zu golden frames match", golden.count);
+
+    if (golden.out)
+        fclose(golden.out);
+    free(golden.frames);
+    free(golden.selected);
+    golden = (struct golden_s){ 0 };
+    return complete;
+}
+
+bool golden_wants(uint64_t frame) {
+    if (golden.select_all)
+        return true;
+
+    if (golden.has_selection) {
+        while (golden.selected_next < golden.selected_count && golden.selected[golden.selected_next] < frame)
+            golden.selected_next++;
+        return golden.selected_next < golden.selected_count && golden.selected[golden.selected_next] == frame;
+    }
+
+    while (golden.next < golden.count && golden.frames[golden.next].frame < frame)
+        golden.next++;
+    return golden.next < golden.count && golden.frames[golden.next].frame == frame;
+}
+
+bool golden_run(uint64_t frame, const uint32_t *framebuffer) {
+    const uint64_t hash = hash_pixels(framebuffer, PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT);
+
+    if (golden.out && fprintf(golden.out, "%"PRIu64" %016"PRIx64"\n", frame, hash) < 0)
+        LOG_MESG(LOG_WARN, "Couldn't write the hash of frame %"PRIu64"", frame);
+
+    while (golden.next < golden.count && golden.frames[golden.next].frame < frame)
+        golden.next++; // not selected
+    if (golden.next == golden.count || golden.frames[golden.next].frame != frame)
+        return true;
+
+    const uint64_t expected = golden.frames[golden.next++].hash;
+    if (hash != expected) {
+        LOG_MESG(LOG_WARN, "Frame %"PRIu64" diverges from the golden one: %016"PRIx64" instead of %016"PRIx64"", frame, hash, expected);
+        golden.diverged = true;
+        return false;
+    }
+    return true;
+}
+
+bool golden_is_finished() {
+    return golden.count && golden.next == golden.count;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef GOLDEN
+#define GOLDEN
+
+#include <inttypes.h>
+
+/* framebuffer hashes of selected frames, written one "frame hash" line each, and compared
+ * against a golden file made the same way */
+
+bool golden_record_start(const char *path);
+bool golden_compare_start(const char *path);
+/* "all" or a comma separated list of frames, by default the frames of the golden file */
+bool golden_select(const char *frames);
+/* false when the run stopped after `frames` frames before reaching every golden frame */
+bool golden_stop(uint64_t frames);
+
+bool golden_wants(uint64_t frame);
+/* hash the completed framebuffer of `frame`, false when it diverges from the golden one */
+bool golden_run(uint64_t frame, const uint32_t *framebuffer);
+/* every golden frame was compared */
+bool golden_is_finished();
+
+#endif
\ No newline at end of file
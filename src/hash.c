@@ -0,0 +1,68 @@
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "hash.h"
+
+#define HASH_LANES 4
+#define HASH_SEED 0x9E3779B97F4A7C15ULL
+#define HASH_STEP 0xC2B2AE3D27D4EB4FULL
+
+/*
+ * Four 64 bits lanes, each eating two pixels per block of eight: the word is XORed with a key
+ * that changes every block (so that moving pixels around changes the hash), then both of its
+ * 32 bits halves are multiplied together and added to the lane with the word itself.
+ * The AVX2 and scalar versions compute the same value.
+ */
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_pixels(const uint32_t *pixels, size_t count) {
+    uint64_t acc[HASH_LANES];
+    uint64_t key[HASH_LANES];
+    for (uint8_t i = 0; i < HASH_LANES; i++) {
+        acc[i] = HASH_SEED * (i + 1);
+        key[i] = HASH_STEP * (i + 1);
+    }
+
+    const size_t blocks = count / (HASH_LANES * 2);
+
+#ifdef __AVX2__
+    __m256i acc_v = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i key_v = _mm256_loadu_si256((const __m256i *)key);
+    const __m256i step_v = _mm256_set1_epi64x(HASH_STEP);
+    for (size_t i = 0; i < blocks; i++) {
+        const __m256i words = _mm256_loadu_si256((const __m256i *)(pixels + i * HASH_LANES * 2));
+        const __m256i keyed = _mm256_xor_si256(words, key_v);
+        acc_v = _mm256_add_epi64(acc_v, _mm256_add_epi64(_mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32)), words));
+        key_v = _mm256_add_epi64(key_v, step_v);
+    }
+    _mm256_storeu_si256((__m256i *)acc, acc_v);
+#else
+    for (size_t i = 0; i < blocks; i++) {
+        for (uint8_t j = 0; j < HASH_LANES; j++) {
+            uint64_t word;
+            memcpy(&word, pixels + (i * HASH_LANES + j) * 2, sizeof(word));
+            const uint64_t keyed = word ^ (key[j] + i * HASH_STEP);
+            acc[j] += (keyed & 0xFFFFFFFF) * (keyed >> 32) + word;
+        }
+    }
+#endif
+
+    uint64_t h = count;
+    for (size_t i = blocks * HASH_LANES * 2; i < count; i++)
+        h = hash_mix(h ^ pixels[i]);
+    for (uint8_t i = 0; i < HASH_LANES; i++)
+        h = hash_mix(h ^ acc[i]);
+
+    return h;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef HASH
+#define HASH
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* fast non cryptographic hash of ARGB8888 pixels, meant to tell frames apart */
+uint64_t hash_pixels(const uint32_t *pixels, size_t count);
+
+#endif
\ No newline at end of file
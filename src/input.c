@@ -1,15 +1,20 @@
-#include <stdlib.h>
+#include <string.h>
 
 #include <SDL3/SDL.h>
 
-#include "log.h"
-
 #include "input.h"
 #include "memory.h"
+#include "interrupt.h"
+#include "prof.h"
+#include "latency.h"
 
 bool status[INPUT_KEY_END];
+uint8_t buttons = 0; // what the guest sees, latched once per frame
+static bool window_exposed = false;
 
 void input_load() {
+    PROF_SCOPE(PROF_INPUT);
+
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         bool pressed;
@@ -17,9 +22,13 @@ void input_load() {
             pressed = true;
         else if (e.type == SDL_EVENT_KEY_UP)
             pressed = false;
-        else
+        else {
+            if (e.type == SDL_EVENT_WINDOW_EXPOSED || e.type == SDL_EVENT_WINDOW_RESTORED)
+                window_exposed = true;
             continue;
-            
+        }
+
+        const uint8_t host = input_host_buttons();
         switch (e.key.key) {
             case SDLK_ESCAPE:
                 status[INPUT_KEY_ESCAPE] = pressed;
@@ -54,59 +63,99 @@ void input_load() {
             case SDLK_L:
                 status[INPUT_KEY_L] = pressed;
                 break;
+            case SDLK_R:
+                status[INPUT_KEY_R] = pressed;
+                break;
+            case SDLK_TAB:
+                status[INPUT_KEY_TAB] = pressed;
+                break;
+            case SDLK_F1:
+                status[INPUT_KEY_F1] = pressed;
+                break;
+            case SDLK_F2:
+                status[INPUT_KEY_F2] = pressed;
+                break;
         }
+        latency_pressed(input_host_buttons() & ~host, e.key.timestamp);
     }
 }
 
+bool input_window_exposed() {
+    const bool exposed = window_exposed;
+    window_exposed = false;
+    return exposed;
+}
+
 bool input_is_pressed(enum input_key_e query) {
     return status[query];
 }
 
-#define JOYPAD_ADDR 0xFF00
+uint8_t input_host_buttons() {
+    uint8_t host = 0;
+
+    if (status[INPUT_KEY_D])
+        host |= INPUT_BUTTON_RIGHT;
+    if (status[INPUT_KEY_Q])
+        host |= INPUT_BUTTON_LEFT;
+    if (status[INPUT_KEY_Z])
+        host |= INPUT_BUTTON_UP;
+    if (status[INPUT_KEY_S])
+        host |= INPUT_BUTTON_DOWN;
+    if (status[INPUT_KEY_P])
+        host |= INPUT_BUTTON_A;
+    if (status[INPUT_KEY_L])
+        host |= INPUT_BUTTON_B;
+    if (status[INPUT_KEY_BACKSPACE])
+        host |= INPUT_BUTTON_SELECT;
+    if (status[INPUT_KEY_ENTER])
+        host |= INPUT_BUTTON_START;
+
+    return host;
+}
+
 #define SELECT_D_PAD 0x10
-    #define RIGHT 0x01
-    #define LEFT 0x02
-    #define UP 0x04
-    #define DOWN 0x08
 #define SELECT_BUTTONS 0x20
-    #define A 0x01
-    #define B 0x02
-    #define SELECT 0x04
-    #define START 0x08
-
-void input_run() {
-    static bool startup = true;
-    uint8_t select = memory_read_8(JOYPAD_ADDR);
-    if ((!(select & SELECT_D_PAD)) && (!(select & SELECT_BUTTONS))) {
-        if (startup)
-            return;
-        LOG_MESG(LOG_WARN, "Both d-pad and buttons are selected");
-        exit(EXIT_FAILURE);
-    }
 
-    startup = false;
-
-    select |= 0xCF;
-
-    if (!(select & SELECT_D_PAD)) {
-        if (status[INPUT_KEY_D])
-            select &= ~RIGHT;
-        if (status[INPUT_KEY_Q])
-            select &= ~LEFT;
-        if (status[INPUT_KEY_Z])
-            select &= ~UP;
-        if (status[INPUT_KEY_S])
-            select &= ~DOWN;
-    } else if (!(select & SELECT_BUTTONS)) {
-        if (status[INPUT_KEY_P])
-            select &= ~A;
-        if (status[INPUT_KEY_L])
-            select &= ~B;
-        if (status[INPUT_KEY_BACKSPACE])
-            select &= ~SELECT;
-        if (status[INPUT_KEY_ENTER])
-            select &= ~START;
-    }
+/* low nibble of JOYP, a line reads 0 when a pressed button of a selected group is on it */
+static uint8_t input_joyp_lines(uint8_t select, uint8_t pressed) {
+    uint8_t lines = 0x0F;
+    if (!(select & SELECT_D_PAD))
+        lines &= ~(pressed & 0x0F);
+    if (!(select & SELECT_BUTTONS))
+        lines &= ~(pressed >> 4);
+    return lines;
+}
+
+/* the joypad interrupt is requested when any line goes from high to low */
+static void input_joyp_edges(uint8_t before, uint8_t after) {
+    if (before & ~after)
+        interrupt_request_joypad();
+}
+
+void input_set_buttons(uint8_t new_buttons) {
+    const uint8_t select = memory_joyp_select();
+    input_joyp_edges(input_joyp_lines(select, buttons), input_joyp_lines(select, new_buttons));
+    buttons = new_buttons;
+}
 
-    memory_write_8(JOYPAD_ADDR, select);
+uint8_t input_joyp_read(uint8_t select) {
+    const uint8_t joyp = 0xC0 | select | input_joyp_lines(select, buttons);
+    latency_joyp_read(joyp);
+    return joyp;
 }
+
+void input_joyp_written(uint8_t old_select, uint8_t select) {
+    input_joyp_edges(input_joyp_lines(old_select, buttons), input_joyp_lines(select, buttons));
+}
+
+size_t input_state_size() {
+    return sizeof(buttons);
+}
+
+void input_state_save(uint8_t *buffer) {
+    memcpy(buffer, &buttons, sizeof(buttons));
+}
+
+void input_state_load(const uint8_t *buffer) {
+    memcpy(&buttons, buffer, sizeof(buttons));
+}
\ No newline at end of file
@@ -2,17 +2,41 @@
 #define INPUT
 
 #include <inttypes.h>
+#include <stddef.h>
 
 enum input_key_e: uint32_t {
     INPUT_KEY_ESCAPE,
     INPUT_KEY_ARROW_UP, INPUT_KEY_ARROW_DOWN,
     INPUT_KEY_Z, INPUT_KEY_S, INPUT_KEY_Q, INPUT_KEY_D, INPUT_KEY_P, INPUT_KEY_L,
     INPUT_KEY_ENTER, INPUT_KEY_BACKSPACE,
+    INPUT_KEY_R, INPUT_KEY_TAB, INPUT_KEY_F1, INPUT_KEY_F2,
     INPUT_KEY_END // Do not use
 };
 
+/* gameboy buttons, the d-pad in the low nibble and the buttons in the high one, as read in JOYP */
+#define INPUT_BUTTON_RIGHT 0x01
+#define INPUT_BUTTON_LEFT 0x02
+#define INPUT_BUTTON_UP 0x04
+#define INPUT_BUTTON_DOWN 0x08
+#define INPUT_BUTTON_A 0x10
+#define INPUT_BUTTON_B 0x20
+#define INPUT_BUTTON_SELECT 0x40
+#define INPUT_BUTTON_START 0x80
+
 void input_load();
 bool input_is_pressed(enum input_key_e query);
-void input_run();
+/* a window was exposed or restored since the last call, what it showed has to be presented again */
+bool input_window_exposed();
+uint8_t input_host_buttons();
+void input_set_buttons(uint8_t buttons);
+/* JOYP as the guest reads it, for the `select` bits it wrote */
+uint8_t input_joyp_read(uint8_t select);
+/* the guest wrote new select bits to JOYP */
+void input_joyp_written(uint8_t old_select, uint8_t select);
+
+/* the buttons latched for the frame, against which the next ones are compared for edges */
+size_t input_state_size();
+void input_state_save(uint8_t *buffer);
+void input_state_load(const uint8_t *buffer);
 
 #endif
\ No newline at end of file
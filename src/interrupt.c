@@ -1,9 +1,12 @@
+#include <string.h>
+
 #include "log.h"
 
 #include "interrupt.h"
 #include "timer.h"
 #include "memory.h"
 #include "cpu.h"
+#include "prof.h"
 
 #define INTERRUPT_IF 0xFF0F
 #define INTERRUPT_IE 0xFFFF
@@ -16,6 +19,8 @@
 #define INT_SERIAL  0b00'00'10'00
 #define INT_JOYPAD  0b00'01'00'00
 
+#define SERVICED_INTERRUPT (INT_TIMER | INT_JOYPAD) // nothing requests the others yet
+
 #define INTERRUPT_ADDR_VBLANK   0x40
 #define INTERRUPT_ADDR_LCDSTAT  0x48
 #define INTERRUPT_ADDR_TIMER    0x50
@@ -37,29 +42,45 @@ void interrupt_enable() {
 }
 
 void interrupt_run(uint8_t m_cycles) {
+    PROF_SCOPE(PROF_TIMER);
+
     if (timer_run(m_cycles))
         memory_write_8(INTERRUPT_IF, memory_read_8(INTERRUPT_IF) | INT_TIMER);
 
     if (!ime)
         return;
 
-    uint8_t interrupt_ready = memory_read_8(INTERRUPT_IF) & memory_read_8(INTERRUPT_IE) & ALL_INTERRUPT;
+    uint8_t interrupt_ready = memory_read_8(INTERRUPT_IF) & memory_read_8(INTERRUPT_IE) & SERVICED_INTERRUPT;
+    interrupt_ready &= -interrupt_ready; // only the one with the highest priority
 
     switch (interrupt_ready) {
-        case INT_VBLANK:
-            return;
-        case INT_LCD:
-            return;
         case INT_TIMER:
             memory_write_8(INTERRUPT_IF, memory_read_8(INTERRUPT_IF) & ~INT_TIMER);
             interrupt_disable();
             cpu_interrupt(INTERRUPT_ADDR_TIMER);
             return;
-        case INT_SERIAL:
-            return;
         case INT_JOYPAD:
+            memory_write_8(INTERRUPT_IF, memory_read_8(INTERRUPT_IF) & ~INT_JOYPAD);
+            interrupt_disable();
+            cpu_interrupt(INTERRUPT_ADDR_JOYPAD);
             return;
         default:
             break;
     }
 }
+
+void interrupt_request_joypad() {
+    memory_write_8(INTERRUPT_IF, memory_read_8(INTERRUPT_IF) | INT_JOYPAD);
+}
+
+size_t interrupt_state_size() {
+    return sizeof(ime);
+}
+
+void interrupt_state_save(uint8_t *buffer) {
+    memcpy(buffer, &ime, sizeof(ime));
+}
+
+void interrupt_state_load(const uint8_t *buffer) {
+    memcpy(&ime, buffer, sizeof(ime));
+}
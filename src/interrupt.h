@@ -2,11 +2,17 @@
 #define INTERRUPT
 
 #include <inttypes.h>
+#include <stddef.h>
 
 void interrupt_reset();
 void interrupt_disable();
 void interrupt_enable();
 
 void interrupt_run(uint8_t m_cycles);
+void interrupt_request_joypad();
+
+size_t interrupt_state_size();
+void interrupt_state_save(uint8_t *buffer);
+void interrupt_state_load(const uint8_t *buffer);
 
 #endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "latency.h"
+
+#define LATENCY_SAMPLES 65536 // per distribution, later presses aren't counted
+#define LATENCY_BUCKET_US 4'000
+#define LATENCY_BUCKETS 10 // the last one holds everything slower
+
+#define JOYP_SELECT_D_PAD 0x10
+#define JOYP_SELECT_BUTTONS 0x20
+
+enum latency_state_e: uint8_t {
+    LATENCY_IDLE,
+    LATENCY_WAIT_READ,
+    LATENCY_WAIT_PRESENT
+};
+
+/* one press followed per button, a new press of the same button replaces it */
+struct latency_probe_s {
+    enum latency_state_e state;
+    uint64_t event_ns;
+};
+
+struct latency_series_s {
+    uint32_t count;
+    uint32_t us[LATENCY_SAMPLES];
+};
+
+struct latency_s {
+    struct latency_probe_s probes[8];
+    uint64_t replaced;
+    struct latency_series_s read;
+    struct latency_series_s present;
+};
+
+static struct latency_s *latency = NULL;
+
+static void latency_add(struct latency_series_s *series, uint64_t event_ns, uint64_t now_ns) {
+    if (series->count < LATENCY_SAMPLES)
+        series->us[series->count++] = now_ns > event_ns ? (now_ns - event_ns) / 1'000 : 0;
+}
+
+static int latency_compare(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void latency_report(const char *name, struct latency_series_s *series) {
+    if (!series->count) {
+        LOG_MESG(LOG_INFO, "input latency to %s: no samples", name);
+        return;
+    }
+
+    qsort(series->us, series->count, sizeof(*series->us), latency_compare);
+    const uint32_t *us = series->us, n = series->count;
+    LOG_MESG(LOG_INFO, "input latency to %s over %"PRIu32" presses: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms",
+        name, n, us[n / 2] / 1e3, us[n * 9 / 10] / 1e3, us[n * 99 / 100] / 1e3, us[n - 1] / 1e3);
+
+    uint32_t buckets[LATENCY_BUCKETS] = { 0 };
+    for (uint32_t i = 0; i < n; i++)
+        buckets[us[i] / LATENCY_BUCKET_US < LATENCY_BUCKETS ? us[i] / LATENCY_BUCKET_US : LATENCY_BUCKETS - 1]++;
+
+    char line[LATENCY_BUCKETS * 12] = "";
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), " %"PRIu32"", buckets[i]);
+    LOG_MESG(LOG_INFO, "input latency to %s, presses per %d ms:%s", name, LATENCY_BUCKET_US / 1'000, line);
+}
+
+void latency_start() {
+    latency = calloc(1, sizeof(struct latency_s));
+    if (!latency)
+        LOG_MESG(LOG_WARN, "Couldn't malloc, input latency isn't measured");
+}
+
+void latency_stop() {
+    if (!latency)
+        return;
+
+    latency_report("joypad read", &latency->read);
+    latency_report("present", &latency->present);
+    if (latency->replaced)
+        LOG_MESG(LOG_INFO, "input latency: %"PRIu64" presses were pressed again before being seen", latency->replaced);
+
+    free(latency);
+    latency = NULL;
+}
+
+void latency_pressed(uint8_t buttons, uint64_t event_ns) {
+    if (!latency)
+        return;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (!(buttons & (1 << i)))
+            continue;
+        if (latency->probes[i].state != LATENCY_IDLE)
+            latency->replaced++;
+        latency->probes[i] = (struct latency_probe_s){ .state = LATENCY_WAIT_READ, .event_ns = event_ns };
+    }
+}
+
+void latency_joyp_read(uint8_t joyp) {
+    if (!latency)
+        return;
+
+    uint64_t now_ns = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        struct latency_probe_s *probe = &latency->probes[i];
+        if (probe->state != LATENCY_WAIT_READ)
+            continue;
+
+        // the d-pad is the low nibble of the buttons, pressed and selected lines read as 0
+        const uint8_t select = i < 4 ? JOYP_SELECT_D_PAD : JOYP_SELECT_BUTTONS;
+        if ((joyp & select) || (joyp & (1 << (i & 3))))
+            continue;
+
+        if (!now_ns)
+            now_ns = SDL_GetTicksNS();
+        latency_add(&latency->read, probe->event_ns, now_ns);
+        probe->state = LATENCY_WAIT_PRESENT;
+    }
+}
+
+void latency_presented() {
+    if (!latency)
+        return;
+
+    uint64_t now_ns = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        struct latency_probe_s *probe = &latency->probes[i];
+        if (probe->state != LATENCY_WAIT_PRESENT)
+            continue;
+
+        if (!now_ns)
+            now_ns = SDL_GetTicksNS();
+        latency_add(&latency->present, probe->event_ns, now_ns);
+        probe->state = LATENCY_IDLE;
+    }
+}
\ No newline at end of file
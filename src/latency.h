@@ -0,0 +1,18 @@
+#ifndef LATENCY
+#define LATENCY
+
+#include <inttypes.h>
+
+/* time from a button pressed on the host to the guest reading it in JOYP, and to the first present after */
+
+void latency_start();
+/* logs both distributions */
+void latency_stop();
+
+/* `buttons` newly pressed, INPUT_BUTTON_* bits, by an event at `event_ns` on the SDL clock */
+void latency_pressed(uint8_t buttons, uint64_t event_ns);
+/* the guest read `joyp` from 0xFF00 */
+void latency_joyp_read(uint8_t joyp);
+void latency_presented();
+
+#endif
\ No newline at end of file
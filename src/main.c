@@ -1,59 +1,281 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
 
 #include "log.h"
 
+#include "main.h"
 #include "screen.h"
 #include "rom_select.h"
 #include "input.h"
 #include "cartridge.h"
-#include "memory.h"
-#include "cpu.h"
-#include "interrupt.h"
-#include "cpu_debug.h"
 #include "ppu.h"
+#include "fps.h"
+#include "state.h"
+#include "rewind.h"
+#include "movie.h"
+#include "netplay.h"
+#include "viewer.h"
+#include "golden.h"
+#include "capture.h"
+#include "osd.h"
+#include "prof.h"
+#include "metrics.h"
+#include "latency.h"
+#include "bot.h"
+#include "core.h"
 
-uint8_t m_cycles_to_add = 0;
+#define RUN_AHEAD_MAX 8
+#define FRAME_SKIP_MAX 9
+#define FRAME_DURATION_NS (16.74 * 1'000'000)
+#define VSYNC_TOLERANCE_HZ 1
 
-void main_add_m_cycles(uint8_t m_cycles) {
-    m_cycles_to_add = m_cycles;
-}
-
-int main() {
+int main(int argc, char *argv[]) {
     log_init(LOG_DEBUG, NULL);
 
     LOG_MESG(LOG_INFO, "VoxoR Gameboy emulator");
 
-    screen_global_init();
+    uint8_t run_ahead = 0;
+    uint8_t frame_skip = 0;
+    char *load_state_path = NULL, *save_state_path = NULL;
+    size_t rewind_mib = 0;
+    char *record_path = NULL, *play_path = NULL;
+    uint16_t netplay_local_port = 0, netplay_remote_port = 0;
+    const char *theme = "dmg";
+    bool viewers = false;
+    enum scale_filter_e filter = SCALE_NEAREST;
+    char *rom_path = NULL;
+    bool headless = false;
+    uint64_t frames_max = 0;
+    char *hash_out_path = NULL, *golden_path = NULL;
+    bool hash_frames = false;
+    char *capture_path = NULL;
+    char *profile_path = NULL;
+    char *metrics_path = NULL;
+    bool measure_latency = false;
+    char *bot_name = NULL;
+    bool bot_step = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--run-ahead") && i + 1 < argc) {
+            const int frames = atoi(argv[++i]);
+            if (frames < 0 || frames > RUN_AHEAD_MAX) {
+                LOG_MESG(LOG_FATAL, "run ahead must be between 0 and %d frames", RUN_AHEAD_MAX);
+                exit(EXIT_FAILURE);
+            }
+            run_ahead = frames;
+            continue;
+        }
 
-    struct screen_s *gb_screen = screen_create("VoxoR Gameboy Emulator", 160, 144, 4);
-    if (!gb_screen) {
-        LOG_MESG(LOG_FATAL, "Couldn't create gameboy screen");
-        screen_global_shutdown();
+        if (!strcmp(argv[i], "--frame-skip") && i + 1 < argc) {
+            const int frames = atoi(argv[++i]);
+            if (frames < 0 || frames > FRAME_SKIP_MAX) {
+                LOG_MESG(LOG_FATAL, "frame skip must be between 0 and %d frames", FRAME_SKIP_MAX);
+                exit(EXIT_FAILURE);
+            }
+            frame_skip = frames;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--rewind") && i + 1 < argc) {
+            const int mib = atoi(argv[++i]);
+            if (mib <= 0) {
+                LOG_MESG(LOG_FATAL, "rewind buffer size must be a positive number of MiB");
+                exit(EXIT_FAILURE);
+            }
+            rewind_mib = mib;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--play") && i + 1 < argc) {
+            play_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--netplay") && i + 2 < argc) {
+            netplay_local_port = atoi(argv[++i]);
+            netplay_remote_port = atoi(argv[++i]);
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--load-state") && i + 1 < argc) {
+            load_state_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--save-state") && i + 1 < argc) {
+            save_state_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            if (!scale_filter_from_name(argv[++i], &filter)) {
+                LOG_MESG(LOG_FATAL, "Unknown filter %s, available filters are nearest, scale2x, scale3x and lcd", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+            rom_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--headless")) {
+            headless = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames_max = strtoull(argv[++i], NULL, 10);
+            if (!frames_max) {
+                LOG_MESG(LOG_FATAL, "the number of frames to run must be positive");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--hash-out") && i + 1 < argc) {
+            hash_out_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--hash-frames") && i + 1 < argc) {
+            if (!golden_select(argv[++i]))
+                exit(EXIT_FAILURE);
+            hash_frames = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--golden") && i + 1 < argc) {
+            golden_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+            capture_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            profile_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--metrics") && i + 1 < argc) {
+            metrics_path = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--latency")) {
+            measure_latency = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--bot") && i + 1 < argc) {
+            bot_name = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--bot-step")) {
+            bot_step = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--viewers")) {
+            viewers = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--theme") && i + 1 < argc) {
+            theme = argv[++i];
+            continue;
+        }
+
+        LOG_MESG(LOG_WARN, "Unknown argument: %s", argv[i]);
+    }
+
+#ifndef VGE_PROFILE
+    if (profile_path)
+        LOG_MESG(LOG_WARN, "Profiling needs a build with PROFILE=yes, --profile is ignored");
+#endif
+
+    if (!ppu_set_theme(theme)) {
+        LOG_MESG(LOG_FATAL, "Unknown theme %s, available themes are dmg, pocket and grey", theme);
         exit(EXIT_FAILURE);
     }
 
-    struct screen_s *tile_screen = screen_create("Tile debugger", 9 * 16, (9 * (384 / 16)), 4);
-    if (!tile_screen) {
-        LOG_MESG(LOG_FATAL, "Couldn't create gameboy screen");
-        screen_destroy(gb_screen);
-        screen_global_shutdown();
+    if ((record_path || play_path) && rewind_mib) {
+        LOG_MESG(LOG_FATAL, "rewind can't be used while recording or playing a movie");
         exit(EXIT_FAILURE);
     }
 
-    struct screen_s *map_0 = screen_create("Map 0", 256, 256, 4);
-    if (!map_0) {
-        LOG_MESG(LOG_FATAL, "Couldn't create gameboy screen");
-        screen_destroy(tile_screen);
-        screen_destroy(gb_screen);
-        screen_global_shutdown();
+    if (netplay_local_port && (run_ahead || rewind_mib || record_path || play_path)) {
+        LOG_MESG(LOG_FATAL, "netplay can't be combined with run ahead, rewind or movies");
+        exit(EXIT_FAILURE);
+    }
+
+    if (record_path && play_path) {
+        LOG_MESG(LOG_FATAL, "can't record and play a movie at the same time");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((hash_out_path || golden_path || hash_frames) && (run_ahead || rewind_mib || netplay_local_port)) {
+        LOG_MESG(LOG_FATAL, "framebuffer hashes can't be combined with run ahead, rewind or netplay");
+        exit(EXIT_FAILURE);
+    }
+
+    if (hash_frames && !hash_out_path && !golden_path) {
+        LOG_MESG(LOG_FATAL, "--hash-frames needs --hash-out or --golden");
         exit(EXIT_FAILURE);
     }
 
-    char *rom = rom_select_select(gb_screen);
+    if (bot_step && !bot_name) {
+        LOG_MESG(LOG_FATAL, "--bot-step needs --bot");
+        exit(EXIT_FAILURE);
+    }
+
+    // a bot agent stops the run by ending the process
+    if (headless && (!rom_path || (!frames_max && !play_path && !golden_path && !bot_name))) {
+        LOG_MESG(LOG_FATAL, "headless runs need --rom, and --frames, --play, --golden or --bot to know when to stop");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((hash_out_path && !golden_record_start(hash_out_path)) || (golden_path && !golden_compare_start(golden_path))) {
+        LOG_MESG(LOG_FATAL, "Couldn't start hashing the framebuffer");
+        exit(EXIT_FAILURE);
+    }
+
+    /* headless runs never touch SDL video, nor the keyboard, nor the clock */
+    struct screen_s *gb_screen = NULL;
+    bool vsync = false;
+    if (!headless) {
+        screen_global_init();
+
+        gb_screen = screen_create("VoxoR Gameboy Emulator", 160, 144, 4);
+        if (!gb_screen) {
+            LOG_MESG(LOG_FATAL, "Couldn't create gameboy screen");
+            screen_global_shutdown();
+            exit(EXIT_FAILURE);
+        }
+
+        if (!screen_set_filter(gb_screen, filter))
+            LOG_MESG(LOG_WARN, "This filter can't scale the screen 4 times, using nearest");
+        /* visible presents flip on the vertical sync, without tearing, when it can pace the frames:
+         * a display much faster or slower than the gameboy would change the game's speed */
+        vsync = fabs(screen_refresh_rate(gb_screen) - GAMEBOY_FRAME_RATE) < VSYNC_TOLERANCE_HZ;
+        screen_set_vsync(gb_screen, vsync);
+    }
+
+    char *rom = rom_path ? rom_path : rom_select_select(gb_screen);
     if (!rom) {
         if (input_is_pressed(INPUT_KEY_ESCAPE)) {
             screen_destroy(gb_screen);
@@ -82,38 +304,257 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    memory_reset();
-    memory_cartridge_load(cartridge);
-    cpu_init();
-    interrupt_reset();
+    core_reset(cartridge);
+
+    if (load_state_path && !state_load_file(load_state_path)) {
+        LOG_MESG(LOG_FATAL, "Couldn't load state %s", load_state_path);
+        cartridge_unload(cartridge);
+        screen_destroy(gb_screen);
+        screen_global_shutdown();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((record_path && !movie_record_start(record_path)) || (play_path && !movie_play_start(play_path))) {
+        LOG_MESG(LOG_FATAL, "Couldn't start the movie");
+        cartridge_unload(cartridge);
+        screen_destroy(gb_screen);
+        screen_global_shutdown();
+        exit(EXIT_FAILURE);
+    }
+
+    if (bot_name && !bot_shm_start(bot_name, bot_step)) {
+        LOG_MESG(LOG_FATAL, "Couldn't share the bot control block");
+        cartridge_unload(cartridge);
+        screen_destroy(gb_screen);
+        screen_global_shutdown();
+        exit(EXIT_FAILURE);
+    }
+
+    if (netplay_local_port && !netplay_start(netplay_local_port, netplay_remote_port)) {
+        LOG_MESG(LOG_FATAL, "Couldn't start netplay");
+        cartridge_unload(cartridge);
+        screen_destroy(gb_screen);
+        screen_global_shutdown();
+        exit(EXIT_FAILURE);
+    }
+
+    if (capture_path && !capture_start(capture_path)) {
+        LOG_MESG(LOG_FATAL, "Couldn't start the capture");
+        cartridge_unload(cartridge);
+        screen_destroy(gb_screen);
+        screen_global_shutdown();
+        exit(EXIT_FAILURE);
+    }
+
+    // monitoring is optional, the emulation goes on without it
+    if (metrics_path && !metrics_start(metrics_path))
+        LOG_MESG(LOG_WARN, "Couldn't serve metrics on %s", metrics_path);
+
+    if (measure_latency && !headless)
+        latency_start();
+
+    uint8_t *run_ahead_state = NULL;
+    if (run_ahead) {
+        run_ahead_state = malloc(state_size());
+        if (!run_ahead_state) {
+            LOG_MESG(LOG_WARN, "Couldn't malloc, running without run ahead");
+            run_ahead = 0;
+        } else
+            LOG_MESG(LOG_INFO, "Running %"PRIu8" frame(s) ahead", run_ahead);
+    }
+
+    if (rewind_mib) {
+        if (!rewind_init(rewind_mib * 1024 * 1024)) {
+            LOG_MESG(LOG_FATAL, "Couldn't allocate the rewind buffer");
+            exit(EXIT_FAILURE);
+        }
+        LOG_MESG(LOG_INFO, "Rewind enabled with %zu MiB, hold R to rewind", rewind_mib);
+    }
+
+    if (gb_screen) {
+        screen_clear(gb_screen);
+        screen_set_framebuffer(gb_screen, ppu_get_framebuffer());
+    }
+    ppu_init();
+
+    /* the debug viewers are optional, the emulation goes on without them */
+    struct screen_s *tile_screen = NULL, *map_0 = NULL;
+    if (viewers && !headless) {
+        tile_screen = screen_create("Tile debugger", VIEWER_TILES_WIDTH, VIEWER_TILES_HEIGHT, 4);
+        map_0 = screen_create("Map 0", VIEWER_MAP_SIZE, VIEWER_MAP_SIZE, 4);
+        if (!tile_screen || !map_0 || !viewer_init(tile_screen, map_0)) {
+            LOG_MESG(LOG_WARN, "Couldn't open the debug viewers");
+            screen_destroy(tile_screen);
+            screen_destroy(map_0);
+            tile_screen = map_0 = NULL;
+        }
+    }
 
-    uint64_t m_cycles_total = 0, instruction_executed = 0;
+    uint64_t frame = 0, dropped_frames = 0;
 
-    screen_clear(gb_screen);
+    if (gb_screen)
+        osd_init(gb_screen);
+    bool osd_key_held = false, profile_key_held = false;
 
-    input_load();
+    if (!headless)
+        input_load();
+    PROF_INIT();
     do {
-        input_run();
-        if (!cpu_debug_run())
+        input_set_buttons(movie_run(frame, bot_buttons(frame, input_host_buttons())));
+        if (bot_agent_lost())
             break;
-        uint8_t m_cycles = cpu_execute();
-        m_cycles += m_cycles_to_add;
-        m_cycles_to_add = 0;
-        if (!m_cycles) {
-            LOG_MESG(LOG_FATAL, "cpu failed to execute!");
-            LOG_MESG(LOG_FATAL, "m cycles elapsed: %"PRIu64", instructions executed: %"PRIu64"", m_cycles_total, instruction_executed);
-            exit(EXIT_FAILURE);
+
+        const bool osd_key = input_is_pressed(INPUT_KEY_F1);
+        if (osd_key && !osd_key_held)
+            osd_toggle();
+        osd_key_held = osd_key;
+
+        // F2 writes the profile so far, which is written again at exit
+        const bool profile_key = input_is_pressed(INPUT_KEY_F2);
+        if (profile_key && !profile_key_held && profile_path)
+            PROF_DUMP(profile_path);
+        profile_key_held = profile_key;
+
+        /* skipped frames keep the timing but aren't drawn: while fast forwarding (TAB held),
+         * only the frames there is time to show are, otherwise one out of `frame_skip + 1` */
+        const bool rewinding = rewind_mib && input_is_pressed(INPUT_KEY_R);
+        const bool fast_forward = !rewinding && input_is_pressed(INPUT_KEY_TAB);
+        const bool hashed = golden_wants(frame);
+        const bool render = hashed || bot_shm_is_active() || (headless ? capture_is_active() : (fast_forward ? fps_due(FRAME_DURATION_NS) : !(frame % (frame_skip + 1))));
+
+        if (netplay_local_port) {
+            uint64_t rollback;
+            if (!netplay_sync(frame, input_host_buttons(), &rollback))
+                break;
+
+            /* the peer's buttons were mispredicted: go back and simulate again headless */
+            if (rollback < frame) {
+                netplay_load(rollback);
+                for (uint64_t f = rollback; f < frame; f++) {
+                    netplay_save(f);
+                    input_set_buttons(netplay_buttons(f));
+                    core_run_frame(false, true);
+                }
+            }
+
+            netplay_save(frame);
+            input_set_buttons(netplay_buttons(frame));
+            if (!core_run_frame(render, false))
+                break;
+        } else if (rewinding) {
+            /* step one frame back and show it, the frame is not recorded again */
+            if (rewind_pop())
+                core_run_frame(true, true);
+        } else if (!run_ahead || !render) {
+            if (!core_run_frame(render, false))
+                break;
+        } else {
+            /* emulate the real frame headless, then show the one `run_ahead` frames later
+             * with the current inputs, and rewind to the real frame */
+            if (!core_run_frame(false, false))
+                break;
+            state_save(run_ahead_state);
+            for (uint8_t i = 1; i < run_ahead; i++)
+                core_run_frame(false, true);
+            core_run_frame(true, true);
+            // the core would be left in the speculative future otherwise
+            if (!state_load(run_ahead_state)) {
+                LOG_MESG(LOG_FATAL, "Couldn't go back to the real frame after running ahead");
+                break;
+            }
+        }
+
+        if (hashed) {
+            ppu_render_wait();
+            if (!golden_run(frame, ppu_get_framebuffer()))
+                break;
+        }
+
+        if (!rewinding) {
+            frame++;
+            rewind_push();
+        }
+
+        if (bot_shm_is_active()) {
+            ppu_render_wait();
+            bot_shm_publish(frame);
+        }
+
+        if (movie_is_finished()) {
+            LOG_MESG(LOG_INFO, "Movie finished after %"PRIu64" frames", frame);
+            break;
+        }
+
+        if (frame == frames_max || (headless && golden_is_finished()))
+            break;
+
+        if (gb_screen)
+            osd_frame(core_instructions());
+        bool paced = false;
+        if (render || rewinding) {
+            PROF_SCOPE(PROF_PRESENT);
+            ppu_render_wait();
+            if (gb_screen) {
+                // fast forward can't wait for the display
+                screen_set_vsync(gb_screen, vsync && !fast_forward);
+                paced = screen_present(gb_screen);
+            }
+            latency_presented();
+        }
+
+        /* headless runs go as fast as possible, and a present flipped on the vertical sync
+         * already waited for the display: sleeping on top of it would pace the frame twice */
+        if (!headless) {
+            if (!fast_forward)
+                fps_wait(paced ? 0 : FRAME_DURATION_NS);
+            else if (render)
+                fps_wait(0); // only restarts the clock fps_due() counts from
         }
-        m_cycles_total += m_cycles;
-        instruction_executed++;
-        interrupt_run(m_cycles);
-        ppu_run(m_cycles, gb_screen, NULL, NULL);
+        capture_frame(render || rewinding ? ppu_get_framebuffer() : NULL);
+        if (!render && !rewinding)
+            dropped_frames++;
+        metrics_run(&(struct metrics_counters_s){
+            .frames = frame,
+            .instructions = core_instructions(),
+            .m_cycles = core_m_cycles(),
+            .dropped_frames = dropped_frames
+        });
+        viewer_update();
+        if (!headless)
+            input_load();
+        PROF_FRAME();
     } while(!input_is_pressed(INPUT_KEY_ESCAPE));
 
-    LOG_MESG(LOG_INFO, "m cycles elapsed: %"PRIu64", instructions executed: %"PRIu64"", m_cycles_total, instruction_executed);
+    LOG_MESG(LOG_INFO, "m cycles elapsed: %"PRIu64", instructions executed: %"PRIu64"", core_m_cycles(), core_instructions());
+
+    uint64_t lines_reused, lines_drawn;
+    ppu_render_wait();
+    ppu_line_stats(&lines_reused, &lines_drawn);
+    if (lines_reused + lines_drawn)
+        LOG_MESG(LOG_INFO, "scanlines reused: %"PRIu64" of %"PRIu64" (%.1f%%)", lines_reused, lines_reused + lines_drawn, 100.0 * lines_reused / (lines_reused + lines_drawn));
 
+    if (save_state_path)
+        state_save_file(save_state_path);
+    if (profile_path)
+        PROF_DUMP(profile_path);
+
+    const bool golden_passed = golden_stop(frame);
+    bot_shm_stop();
+    latency_stop();
+    metrics_stop();
+    capture_stop();
+    netplay_stop();
+    movie_stop(frame);
+    rewind_shutdown();
+    free(run_ahead_state);
+    ppu_shutdown();
+    viewer_shutdown();
+    if (tile_screen)
+        screen_destroy(tile_screen);
+    if (map_0)
+        screen_destroy(map_0);
     cartridge_unload(cartridge);
     screen_destroy(gb_screen);
     screen_global_shutdown();
-    exit(EXIT_SUCCESS);
+    exit(golden_passed ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -3,7 +3,7 @@
 
 #define GAMEBOY_HERTZ_CLOCK 4'194'304
 #define GAMEBOY_MACHINE_CLOCK (GAMEBOY_HERTZ_CLOCK / 4)
-
-void main_add_m_cycles(uint8_t m_cycles);
+#define GAMEBOY_FRAME_CLOCKS 70'224 // 154 lines of 456 clocks
+#define GAMEBOY_FRAME_RATE ((double)GAMEBOY_HERTZ_CLOCK / GAMEBOY_FRAME_CLOCKS) // about 59.73
 
 #endif
\ No newline at end of file
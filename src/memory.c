@@ -1,11 +1,20 @@
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "log.h"
 
 #include "memory.h"
-#include "main.h"
+#include "core.h"
+#include "ppu.h"
+#include "prof.h"
+#include "input.h"
 
+#define JOYPAD_ADDR 0xFF00
+#define JOYPAD_SELECT 0x30 // the only bits written, the others are computed on read
 #define OAM_DMA_ADDR 0xFF46
+#define BGP_ADDR 0xFF47
+#define OBP1_ADDR 0xFF49
 
 #define CARTRIDGE_BANK_0 0x0000
 #define CARTRIDGE_BANK_0_SIZE 0x4000
@@ -15,10 +24,8 @@
 #define VIDEO_RAM_SIZE 0x2000
 #define CARTRIDGE_RAM 0xA000
 #define CARTRIDGE_RAM_SIZE 0x2000
-#define WORK_RAM_0 0xC000
-#define WORK_RAM_0_SIZE 0x1000
-#define WORK_RAM_N 0xD000
-#define WORK_RAM_N_SIZE 0x1000
+#define WORK_RAM 0xC000
+#define WORK_RAM_SIZE 0x2000 // bank 0 then the switchable one, always bank 1 on DMG
 #define ECHO_RAM 0xE000
 #define ECHO_RAM_SIZE 0x0E00
 #define OAM_RAM 0xFE00
@@ -37,8 +44,7 @@ struct memory_s {
     uint8_t *cartridge_bank_n;
     uint8_t video_ram[VIDEO_RAM_SIZE];
     // uint8_t cartridge_ram;
-    uint8_t work_ram_0[WORK_RAM_0_SIZE];
-    uint8_t work_ram_n[WORK_RAM_N_SIZE];
+    uint8_t work_ram[WORK_RAM_SIZE];
     uint8_t oam_ram[OAM_RAM_SIZE];
     uint8_t io[IO_SIZE];
     uint8_t high_ram[HIGH_RAM_SIZE];
@@ -47,6 +53,10 @@ struct memory_s {
 
 struct memory_s memory;
 
+/* everything but the cartridge pointers, which are restored from the loaded cartridge */
+#define MEMORY_STATE_BEGIN offsetof(struct memory_s, video_ram)
+#define MEMORY_STATE_SIZE (offsetof(struct memory_s, intterupt_enable) + sizeof(memory.intterupt_enable) - MEMORY_STATE_BEGIN)
+
 void memory_reset() {
     memory.cartridge_bank_0 = NULL;
     memory.cartridge_bank_n = NULL;
@@ -62,6 +72,8 @@ void memory_cartridge_load(struct cartridge_s *cartridge) {
 }
 
 uint8_t memory_read_8(uint16_t addr) {
+    PROF_SCOPE(PROF_MEMORY);
+
     if (addr == 0xFF44)
         return 0x90;
 
@@ -71,14 +83,15 @@ uint8_t memory_read_8(uint16_t addr) {
         return *(memory.cartridge_bank_n + (addr - CARTRIDGE_BANK_N));
     if (addr >= VIDEO_RAM && addr < VIDEO_RAM + VIDEO_RAM_SIZE)
         return memory.video_ram[addr - VIDEO_RAM];
-    if (addr >= WORK_RAM_0 && addr < WORK_RAM_0 + WORK_RAM_0_SIZE)
-        return memory.work_ram_0[addr - WORK_RAM_0];
-    if (addr >= WORK_RAM_N && addr < WORK_RAM_N + WORK_RAM_N_SIZE)
-        return memory.work_ram_n[addr - WORK_RAM_N];
+    if (addr >= WORK_RAM && addr < WORK_RAM + WORK_RAM_SIZE)
+        return memory.work_ram[addr - WORK_RAM];
     if (addr >= OAM_RAM && addr < OAM_RAM + OAM_RAM_SIZE)
         return memory.oam_ram[addr - OAM_RAM];
-    if (addr >= IO && addr < IO + IO_SIZE)
+    if (addr >= IO && addr < IO + IO_SIZE) {
+        if (addr == JOYPAD_ADDR)
+            return input_joyp_read(memory.io[0] & JOYPAD_SELECT);
         return memory.io[addr - IO];
+    }
     if (addr >= HIGH_RAM && addr < HIGH_RAM + HIGH_RAM_SIZE)
         return memory.high_ram[addr - HIGH_RAM];
     if (addr == INTERRUPT_ENABLE)
@@ -91,30 +104,38 @@ uint8_t memory_read_8(uint16_t addr) {
 static void start_oam_dma(uint8_t src) {
     for (uint8_t i = 0; i < 0xA0; i++)
         memory.oam_ram[i] = memory_read_8((((uint16_t)src) << 8) + i);
+    ppu_oam_invalidate();
 
-    main_add_m_cycles(160);
+    core_add_m_cycles(160);
 }
 
 void memory_write_8(uint16_t addr, uint8_t value) {
-    if (addr < CARTRIDGE_BANK_0 + CARTRIDGE_BANK_0_SIZE)
-        *(memory.cartridge_bank_0 + addr) = value;
-    else if (addr < CARTRIDGE_BANK_N + CARTRIDGE_BANK_N_SIZE)
-        *(memory.cartridge_bank_n + (addr - CARTRIDGE_BANK_N)) = value;
-    else if (addr >= VIDEO_RAM && addr < VIDEO_RAM + VIDEO_RAM_SIZE)
+    PROF_SCOPE(PROF_MEMORY);
+
+    if (addr < CARTRIDGE_BANK_N + CARTRIDGE_BANK_N_SIZE)
+        return; // ROM is read only, and no MBC is emulated yet
+    else if (addr >= VIDEO_RAM && addr < VIDEO_RAM + VIDEO_RAM_SIZE) {
         memory.video_ram[addr - VIDEO_RAM] = value;
-    else if (addr >= WORK_RAM_0 && addr < WORK_RAM_0 + WORK_RAM_0_SIZE)
-        memory.work_ram_0[addr - WORK_RAM_0] = value;
-    else if (addr >= WORK_RAM_N && addr < WORK_RAM_N + WORK_RAM_N_SIZE)
-        memory.work_ram_n[addr - WORK_RAM_N] = value;
-    else if (addr >= OAM_RAM && addr < OAM_RAM + OAM_RAM_SIZE)
+        ppu_vram_written(addr);
+    } else if (addr >= WORK_RAM && addr < WORK_RAM + WORK_RAM_SIZE)
+        memory.work_ram[addr - WORK_RAM] = value;
+    else if (addr >= OAM_RAM && addr < OAM_RAM + OAM_RAM_SIZE) {
         memory.oam_ram[addr - OAM_RAM] = value;
-    else if (addr >= UNUSABLE && addr < UNUSABLE + UNUSABLE_SIZE)
+        ppu_oam_written(addr);
+    } else if (addr >= UNUSABLE && addr < UNUSABLE + UNUSABLE_SIZE)
         LOG_MESG(LOG_WARN, "Writing in a forbidden area! (0x%04X)", addr);
     else if (addr == OAM_DMA_ADDR)
         start_oam_dma(value);
-    else if (addr >= IO && addr < IO + IO_SIZE)
+    else if (addr == JOYPAD_ADDR) {
+        const uint8_t old_select = memory.io[0] & JOYPAD_SELECT;
+        memory.io[0] = value & JOYPAD_SELECT;
+        input_joyp_written(old_select, memory.io[0]);
+    }
+    else if (addr >= IO && addr < IO + IO_SIZE) {
         memory.io[addr - IO] = value;
-    else if (addr >= HIGH_RAM && addr < HIGH_RAM + HIGH_RAM_SIZE)
+        if (addr >= BGP_ADDR && addr <= OBP1_ADDR)
+            ppu_palette_written(addr);
+    } else if (addr >= HIGH_RAM && addr < HIGH_RAM + HIGH_RAM_SIZE)
         memory.high_ram[addr - HIGH_RAM] = value;
     else if (addr == INTERRUPT_ENABLE)
         memory.intterupt_enable = value;
@@ -125,29 +146,25 @@ void memory_write_8(uint16_t addr, uint8_t value) {
 }
 
 uint16_t memory_read_16(uint16_t addr) {
+    PROF_SCOPE(PROF_MEMORY);
+
     if (addr < CARTRIDGE_BANK_0 + CARTRIDGE_BANK_0_SIZE - 1)
         return (uint16_t)(*(memory.cartridge_bank_0 + addr) + (*(memory.cartridge_bank_0 + addr + 1) << 8));
     if (addr < CARTRIDGE_BANK_N + CARTRIDGE_BANK_N_SIZE - 1)
         return (uint16_t)(*(memory.cartridge_bank_n + (addr - CARTRIDGE_BANK_N)) + (*(memory.cartridge_bank_n + (addr - CARTRIDGE_BANK_N) + 1) << 8));
-    else if (addr >= WORK_RAM_0 && addr < WORK_RAM_0 + WORK_RAM_0_SIZE - 1)
-        return (uint16_t)(*(memory.work_ram_0 + (addr - WORK_RAM_0)) + (*(memory.work_ram_0 + (addr - WORK_RAM_0) + 1) << 8));
-    else if (addr >= WORK_RAM_N && addr < WORK_RAM_N + WORK_RAM_N_SIZE - 1)
-        return (uint16_t)(*(memory.work_ram_n + (addr - WORK_RAM_N)) + (*(memory.work_ram_n + (addr - WORK_RAM_N) + 1) << 8));
+    else if (addr >= WORK_RAM && addr < WORK_RAM + WORK_RAM_SIZE - 1)
+        return (uint16_t)(*(memory.work_ram + (addr - WORK_RAM)) + (*(memory.work_ram + (addr - WORK_RAM) + 1) << 8));
 
     LOG_MESG(LOG_FATAL, "Couldn't read at addr 0x%04X", addr);
     exit(EXIT_FAILURE);
 }
 
 void memory_write_16(uint16_t addr, uint16_t value) {
-    if (addr >= WORK_RAM_0 && addr < WORK_RAM_0 + WORK_RAM_0_SIZE - 1) { // 4KB Work RAM Bank 0 (WRAM)
-        memory.work_ram_0[addr - WORK_RAM_0 + 1] = (uint8_t)(value >> 8);
-        memory.work_ram_0[addr - WORK_RAM_0] = (uint8_t)(value & 0xFF);
-        return;
-    }
+    PROF_SCOPE(PROF_MEMORY);
 
-    if (addr >= WORK_RAM_N && addr < WORK_RAM_N + WORK_RAM_N_SIZE - 1) { // 4KB Work RAM Bank 0 (WRAM)
-        memory.work_ram_n[addr - WORK_RAM_N + 1] = (uint8_t)(value >> 8);
-        memory.work_ram_n[addr - WORK_RAM_N] = (uint8_t)(value & 0xFF);
+    if (addr >= WORK_RAM && addr < WORK_RAM + WORK_RAM_SIZE - 1) { // 8KB Work RAM (WRAM)
+        memory.work_ram[addr - WORK_RAM + 1] = (uint8_t)(value >> 8);
+        memory.work_ram[addr - WORK_RAM] = (uint8_t)(value & 0xFF);
         return;
     }
 
@@ -161,4 +178,32 @@ uint8_t *memory_special_get_oam_area() {
 
 uint8_t *memory_special_get_vram() {
     return memory.video_ram;
+}
+
+uint8_t *memory_special_get_wram() {
+    return memory.work_ram;
+}
+
+uint8_t *memory_special_get_hram() {
+    return memory.high_ram;
+}
+
+uint8_t memory_joyp_select() {
+    return memory.io[0] & JOYPAD_SELECT;
+}
+
+uint16_t memory_rom_bank() {
+    return 1; // the switchable bank is always the first one until an MBC is emulated
+}
+
+size_t memory_state_size() {
+    return MEMORY_STATE_SIZE;
+}
+
+void memory_state_save(uint8_t *buffer) {
+    memcpy(buffer, ((uint8_t *)&memory) + MEMORY_STATE_BEGIN, MEMORY_STATE_SIZE);
+}
+
+void memory_state_load(const uint8_t *buffer) {
+    memcpy(((uint8_t *)&memory) + MEMORY_STATE_BEGIN, buffer, MEMORY_STATE_SIZE);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define MEMORY
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "cartridge.h"
 
@@ -16,5 +17,15 @@ uint16_t memory_read_16(uint16_t addr);
 void memory_write_16(uint16_t addr, uint16_t value);
 uint8_t *memory_special_get_oam_area();
 uint8_t *memory_special_get_vram();
+uint8_t *memory_special_get_wram(); // both banks, 0xC000-0xDFFF
+uint8_t *memory_special_get_hram();
+/* select bits last written to JOYP */
+uint8_t memory_joyp_select();
+/* cartridge bank mapped at 0x4000 */
+uint16_t memory_rom_bank();
+
+size_t memory_state_size();
+void memory_state_save(uint8_t *buffer);
+void memory_state_load(const uint8_t *buffer);
 
 #endif
\ No newline at end of file
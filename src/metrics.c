@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "log.h"
+
+#include "metrics.h"
+#include "main.h"
+#include "cpu.h"
+#include "memory.h"
+#include "capture.h"
+
+#define METRICS_ACCEPT_MAX 16 // connections answered per frame, the others wait for the next one
+#define METRICS_SPEED_WINDOW_NS 1'000'000'000
+#define METRICS_TEXT_SIZE 1024
+
+/* A scrape is a connect and a read until the end of the stream, in the prometheus text format:
+ *     socat - UNIX-CONNECT:/tmp/vge.sock */
+
+#ifdef _WIN32
+
+bool metrics_start(const char *path) {
+    (void)path;
+    LOG_MESG(LOG_WARN, "Metrics are not supported on Windows yet");
+    return false;
+}
+
+void metrics_stop() {
+}
+
+void metrics_run(const struct metrics_counters_s *counters) {
+    (void)counters;
+}
+
+#else
+
+struct metrics_s {
+    int socket;
+    struct sockaddr_un addr;
+
+    /* the emulated speed, measured over about a second */
+    uint64_t window_ns;
+    uint64_t window_frames;
+    double speed;
+
+    uint64_t served;
+};
+
+static struct metrics_s *metrics = NULL;
+
+static uint64_t metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+}
+
+bool metrics_start(const char *path) {
+    if (strlen(path) >= sizeof(metrics->addr.sun_path)) {
+        LOG_MESG(LOG_WARN, "Socket path %s is too long", path);
+        return false;
+    }
+
+    metrics = calloc(1, sizeof(struct metrics_s));
+    if (!metrics) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    metrics->addr.sun_family = AF_UNIX;
+    strcpy(metrics->addr.sun_path, path);
+    metrics->window_ns = metrics_now_ns();
+
+    metrics->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (metrics->socket < 0) {
+        LOG_MESG(LOG_WARN, "Couldn't create the metrics socket");
+        free(metrics);
+        metrics = NULL;
+        return false;
+    }
+
+    unlink(path); // left over by an instance that didn't stop cleanly
+    if (bind(metrics->socket, (struct sockaddr *)&metrics->addr, sizeof(metrics->addr)) || listen(metrics->socket, METRICS_ACCEPT_MAX) || fcntl(metrics->socket, F_SETFL, O_NONBLOCK)) {
+        LOG_MESG(LOG_WARN, "Couldn't listen on %s", path);
+        close(metrics->socket);
+        free(metrics);
+        metrics = NULL;
+        return false;
+    }
+
+    LOG_MESG(LOG_INFO, "Serving metrics on %s", path);
+    return true;
+}
+
+void metrics_stop() {
+    if (!metrics)
+        return;
+
+    LOG_MESG(LOG_INFO, "Metrics served %"PRIu64" times", metrics->served);
+    close(metrics->socket);
+    unlink(metrics->addr.sun_path);
+    free(metrics);
+    metrics = NULL;
+}
+
+static int metrics_format(char *text, const struct metrics_counters_s *counters) {
+    return snprintf(text, METRICS_TEXT_SIZE,
+        "# TYPE vge_frames_total counter\nvge_frames_total %"PRIu64"\n"
+        "# TYPE vge_instructions_total counter\nvge_instructions_total %"PRIu64"\n"
+        "# TYPE vge_m_cycles_total counter\nvge_m_cycles_total %"PRIu64"\n"
+        "# TYPE vge_speed_ratio gauge\nvge_speed_ratio %.3f\n"
+        "# TYPE vge_dropped_frames_total counter\nvge_dropped_frames_total %"PRIu64"\n"
+        "# TYPE vge_capture_backlog gauge\nvge_capture_backlog %"PRIu32"\n"
+        "# TYPE vge_pc gauge\nvge_pc %"PRIu16"\n"
+        "# TYPE vge_rom_bank gauge\nvge_rom_bank %"PRIu16"\n",
+        counters->frames, counters->instructions, counters->m_cycles, metrics->speed, counters->dropped_frames,
+        capture_backlog(), cpu_get_pc(), memory_rom_bank());
+}
+
+void metrics_run(const struct metrics_counters_s *counters) {
+    if (!metrics)
+        return;
+
+    const uint64_t now_ns = metrics_now_ns();
+    if (now_ns - metrics->window_ns >= METRICS_SPEED_WINDOW_NS) {
+        // in frames, as the ppu frame length isn't the hardware's yet
+        const double frame_rate = (counters->frames - metrics->window_frames) * 1e9 / (now_ns - metrics->window_ns);
+        metrics->speed = frame_rate / GAMEBOY_FRAME_RATE;
+        metrics->window_ns = now_ns;
+        metrics->window_frames = counters->frames;
+    }
+
+    char text[METRICS_TEXT_SIZE];
+    int len = -1;
+    for (uint8_t i = 0; i < METRICS_ACCEPT_MAX; i++) {
+        const int client = accept(metrics->socket, NULL, NULL);
+        if (client < 0)
+            break;
+
+        if (len < 0)
+            len = metrics_format(text, counters);
+        // a fresh socket buffer holds the whole text, this doesn't block
+        send(client, text, len, MSG_NOSIGNAL);
+        close(client);
+        metrics->served++;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef METRICS
+#define METRICS
+
+#include <inttypes.h>
+
+/* counters served as text to whoever connects to a unix socket, one "name value" line each */
+
+struct metrics_counters_s {
+    uint64_t frames;
+    uint64_t instructions;
+    uint64_t m_cycles;
+    uint64_t dropped_frames; // emulated without being shown
+};
+
+bool metrics_start(const char *path);
+void metrics_stop();
+
+/* once per frame: answers the pending connections, never waits */
+void metrics_run(const struct metrics_counters_s *counters);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "movie.h"
+#include "state.h"
+
+#define MOVIE_MAGIC "VGEM"
+#define MOVIE_VERSION 1
+
+/* file layout: header, the state the movie starts from, then one record
+ * each time the buttons change, until the end of the file */
+
+struct movie_header_s {
+    char magic[4];
+    uint32_t version;
+    uint32_t state_size;
+};
+
+struct movie_record_s {
+    uint32_t frame;
+    uint8_t buttons;
+} __attribute__((packed));
+
+enum movie_mode_e: uint8_t {
+    MOVIE_MODE_NONE,
+    MOVIE_MODE_RECORD,
+    MOVIE_MODE_PLAY
+};
+
+struct movie_s {
+    enum movie_mode_e mode;
+    FILE *f;
+    uint8_t buttons;
+    bool has_next;
+    struct movie_record_s next;
+};
+
+static struct movie_s movie = { .mode = MOVIE_MODE_NONE };
+
+bool movie_record_start(const char *path) {
+    movie.f = fopen(path, "wb");
+    if (!movie.f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        return false;
+    }
+
+    const size_t size = state_size();
+    uint8_t *state = malloc(size);
+    if (!state) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        fclose(movie.f);
+        return false;
+    }
+    state_save(state);
+
+    struct movie_header_s header = {
+        .magic = MOVIE_MAGIC,
+        .version = MOVIE_VERSION,
+        .state_size = size
+    };
+
+    const bool written = fwrite(&header, sizeof(header), 1, movie.f) == 1 && fwrite(state, size, 1, movie.f) == 1;
+    free(state);
+    if (!written) {
+        LOG_MESG(LOG_WARN, "Couldn't write movie header to %s", path);
+        fclose(movie.f);
+        return false;
+    }
+
+    movie.mode = MOVIE_MODE_RECORD;
+    movie.buttons = 0;
+    LOG_MESG(LOG_INFO, "Recording movie to %s", path);
+    return true;
+}
+
+static void movie_read_next() {
+    movie.has_next = fread(&movie.next, sizeof(movie.next), 1, movie.f) == 1;
+}
+
+bool movie_play_start(const char *path) {
+    movie.f = fopen(path, "rb");
+    if (!movie.f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        return false;
+    }
+
+    struct movie_header_s header;
+    if (fread(&header, sizeof(header), 1, movie.f) != 1 || memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) || header.version != MOVIE_VERSION) {
+        LOG_MESG(LOG_WARN, "%s is not a supported movie", path);
+        fclose(movie.f);
+        return false;
+    }
+
+    if (header.state_size != state_size()) {
+        LOG_MESG(LOG_WARN, "Movie %s was recorded with another state layout", path);
+        fclose(movie.f);
+        return false;
+    }
+
+    uint8_t *state = malloc(header.state_size);
+    if (!state) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        fclose(movie.f);
+        return false;
+    }
+
+    const bool loaded = fread(state, header.state_size, 1, movie.f) == 1 && state_load(state);
+    free(state);
+    if (!loaded) {
+        LOG_MESG(LOG_WARN, "Couldn't restore the state of movie %s", path);
+        fclose(movie.f);
+        return false;
+    }
+
+    movie.mode = MOVIE_MODE_PLAY;
+    movie.buttons = 0;
+    movie_read_next();
+    LOG_MESG(LOG_INFO, "Playing movie %s", path);
+    return true;
+}
+
+void movie_stop(uint64_t frames) {
+    if (movie.mode == MOVIE_MODE_NONE)
+        return;
+
+    if (movie.mode == MOVIE_MODE_RECORD && frames) {
+        // mark the last frame so the playback stops at the same point
+        struct movie_record_s record = { .frame = frames - 1, .buttons = movie.buttons };
+        if (fwrite(&record, sizeof(record), 1, movie.f) != 1)
+            LOG_MESG(LOG_WARN, "Couldn't write the last movie record");
+    }
+
+    fclose(movie.f);
+    movie.mode = MOVIE_MODE_NONE;
+}
+
+uint8_t movie_run(uint64_t frame, uint8_t buttons) {
+    switch (movie.mode) {
+        case MOVIE_MODE_RECORD:
+            if (buttons != movie.buttons) {
+                struct movie_record_s record = { .frame = frame, .buttons = buttons };
+                if (fwrite(&record, sizeof(record), 1, movie.f) != 1)
+                    LOG_MESG(LOG_WARN, "Couldn't write movie record at frame %"PRIu64"", frame);
+                movie.buttons = buttons;
+            }
+            return buttons;
+        case MOVIE_MODE_PLAY:
+            while (movie.has_next && movie.next.frame <= frame) {
+                movie.buttons = movie.next.buttons;
+                movie_read_next();
+            }
+            return movie.buttons;
+        case MOVIE_MODE_NONE:
+        default:
+            return buttons;
+    }
+}
+
+bool movie_is_finished() {
+    return movie.mode == MOVIE_MODE_PLAY && !movie.has_next;
+}
\ No newline at end of file
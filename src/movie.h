@@ -0,0 +1,14 @@
+#ifndef MOVIE
+#define MOVIE
+
+#include <inttypes.h>
+
+bool movie_record_start(const char *path);
+bool movie_play_start(const char *path);
+void movie_stop(uint64_t frames);
+
+/* called once per emulated frame with the host buttons, returns the buttons to feed the guest */
+uint8_t movie_run(uint64_t frame, uint8_t buttons);
+bool movie_is_finished();
+
+#endif
\ No newline at end of file
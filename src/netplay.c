@@ -0,0 +1,287 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "log.h"
+
+#include "netplay.h"
+#include "state.h"
+
+#define NETPLAY_MAX_ROLLBACK 16 // frames kept to roll back to, the peer can't be further behind
+#define NETPLAY_INPUT_RING 64
+#define NETPLAY_MAX_SEND 48 // more than the 2 * NETPLAY_MAX_ROLLBACK frames a peer can miss
+#define NETPLAY_POLL_MS 1
+#define NETPLAY_TIMEOUT_MS 10'000
+
+/* Both processes run the same rom from the same state and exchange their buttons for every frame.
+ * The guest sees both players' buttons or'ed, so both instances stay identical.
+ * A frame is simulated right away with the last known remote buttons, and when the real ones differ
+ * the state is restored to that frame and the following frames are simulated again headless. */
+
+struct netplay_packet_s {
+    uint32_t ack;         // first frame of the peer not received yet
+    uint32_t first_frame; // frame of buttons[0]
+    uint8_t count;
+    uint8_t buttons[NETPLAY_MAX_SEND];
+} __attribute__((packed));
+
+struct netplay_input_s {
+    uint64_t frame;
+    bool valid;
+    uint8_t buttons;
+};
+
+struct netplay_snapshot_s {
+    uint64_t frame;
+    bool used; // remote buttons the frame was simulated with
+    uint8_t remote;
+    uint8_t *state;
+};
+
+struct netplay_s {
+    int socket;
+    struct sockaddr_in remote_addr;
+
+    struct netplay_input_s local[NETPLAY_INPUT_RING];
+    struct netplay_input_s remote[NETPLAY_INPUT_RING];
+    uint64_t remote_known; // every remote frame before this one was received
+    uint64_t remote_ack;   // every local frame before this one was received by the peer
+
+    struct netplay_snapshot_s snapshots[NETPLAY_MAX_ROLLBACK];
+
+    uint64_t rollbacks;
+    uint64_t rollback_frames;
+};
+
+static struct netplay_s *netplay = NULL;
+
+#ifdef _WIN32
+
+bool netplay_start(uint16_t local_port, uint16_t remote_port) {
+    (void)local_port;
+    (void)remote_port;
+    LOG_MESG(LOG_WARN, "Netplay is not supported on Windows yet");
+    return false;
+}
+
+void netplay_stop() {
+}
+
+bool netplay_sync(uint64_t frame, uint8_t buttons, uint64_t *rollback) {
+    (void)buttons;
+    *rollback = frame;
+    return false;
+}
+
+#else
+
+static void netplay_send(uint64_t frame) {
+    struct netplay_packet_s packet;
+    uint64_t first = netplay->remote_ack;
+    if (frame + 1 - first > NETPLAY_MAX_SEND)
+        first = frame + 1 - NETPLAY_MAX_SEND;
+
+    packet.ack = netplay->remote_known;
+    packet.first_frame = first;
+    packet.count = 0;
+    for (uint64_t f = first; f <= frame; f++) {
+        const struct netplay_input_s *input = &netplay->local[f % NETPLAY_INPUT_RING];
+        if (!input->valid || input->frame != f)
+            break;
+        packet.buttons[packet.count++] = input->buttons;
+    }
+
+    sendto(netplay->socket, &packet, offsetof(struct netplay_packet_s, buttons) + packet.count, 0, (struct sockaddr *)&netplay->remote_addr, sizeof(netplay->remote_addr));
+}
+
+/* returns the first frame which was simulated with a wrong prediction, or UINT64_MAX */
+static uint64_t netplay_receive(uint64_t frame) {
+    uint64_t rollback = UINT64_MAX;
+    struct netplay_packet_s packet;
+    ssize_t size;
+
+    while ((size = recv(netplay->socket, &packet, sizeof(packet), 0)) >= (ssize_t)offsetof(struct netplay_packet_s, buttons)) {
+        if (packet.ack > netplay->remote_ack)
+            netplay->remote_ack = packet.ack;
+
+        if (packet.count > size - offsetof(struct netplay_packet_s, buttons))
+            continue;
+
+        for (uint8_t i = 0; i < packet.count; i++) {
+            const uint64_t f = (uint64_t)packet.first_frame + i;
+            if (f < netplay->remote_known || f >= netplay->remote_known + NETPLAY_INPUT_RING)
+                continue;
+
+            struct netplay_input_s *input = &netplay->remote[f % NETPLAY_INPUT_RING];
+            input->frame = f;
+            input->valid = true;
+            input->buttons = packet.buttons[i];
+
+            const struct netplay_snapshot_s *snapshot = &netplay->snapshots[f % NETPLAY_MAX_ROLLBACK];
+            if (f < frame && snapshot->frame == f && snapshot->used && snapshot->remote != input->buttons && f < rollback)
+                rollback = f;
+        }
+
+        while (netplay->remote[netplay->remote_known % NETPLAY_INPUT_RING].valid && netplay->remote[netplay->remote_known % NETPLAY_INPUT_RING].frame == netplay->remote_known)
+            netplay->remote_known++;
+    }
+
+    return rollback;
+}
+
+bool netplay_start(uint16_t local_port, uint16_t remote_port) {
+    netplay = calloc(1, sizeof(struct netplay_s));
+    if (!netplay) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+    netplay->socket = -1;
+
+    for (uint8_t i = 0; i < NETPLAY_MAX_ROLLBACK; i++) {
+        netplay->snapshots[i].state = malloc(state_size());
+        if (!netplay->snapshots[i].state) {
+            LOG_MESG(LOG_WARN, "Couldn't malloc");
+            netplay_stop();
+            return false;
+        }
+    }
+
+    netplay->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (netplay->socket < 0) {
+        LOG_MESG(LOG_WARN, "Couldn't create socket");
+        netplay_stop();
+        return false;
+    }
+
+    struct sockaddr_in local_addr = { 0 };
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local_addr.sin_port = htons(local_port);
+    if (bind(netplay->socket, (struct sockaddr *)&local_addr, sizeof(local_addr))) {
+        LOG_MESG(LOG_WARN, "Couldn't bind to port %"PRIu16"", local_port);
+        netplay_stop();
+        return false;
+    }
+
+    fcntl(netplay->socket, F_SETFL, fcntl(netplay->socket, F_GETFL) | O_NONBLOCK);
+
+    netplay->remote_addr.sin_family = AF_INET;
+    netplay->remote_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    netplay->remote_addr.sin_port = htons(remote_port);
+
+    LOG_MESG(LOG_INFO, "Waiting for the peer on port %"PRIu16"", remote_port);
+
+    // both sides send empty packets until they hear from the other one
+    struct pollfd pfd = { .fd = netplay->socket, .events = POLLIN };
+    for (uint32_t waited = 0; waited < NETPLAY_TIMEOUT_MS * 3; waited += 100) {
+        struct netplay_packet_s hello = { .ack = 0, .first_frame = 0, .count = 0 };
+        sendto(netplay->socket, &hello, offsetof(struct netplay_packet_s, buttons), 0, (struct sockaddr *)&netplay->remote_addr, sizeof(netplay->remote_addr));
+
+        if (poll(&pfd, 1, 100) > 0) {
+            netplay_receive(0);
+            LOG_MESG(LOG_INFO, "Peer connected");
+            return true;
+        }
+    }
+
+    LOG_MESG(LOG_WARN, "The peer never answered");
+    netplay_stop();
+    return false;
+}
+
+void netplay_stop() {
+    if (!netplay)
+        return;
+
+    LOG_MESG(LOG_INFO, "Netplay: %"PRIu64" rollbacks, %"PRIu64" frames simulated again", netplay->rollbacks, netplay->rollback_frames);
+
+    if (netplay->socket >= 0)
+        close(netplay->socket);
+    for (uint8_t i = 0; i < NETPLAY_MAX_ROLLBACK; i++)
+        free(netplay->snapshots[i].state);
+    free(netplay);
+    netplay = NULL;
+}
+
+bool netplay_sync(uint64_t frame, uint8_t buttons, uint64_t *rollback) {
+    struct netplay_input_s *input = &netplay->local[frame % NETPLAY_INPUT_RING];
+    input->frame = frame;
+    input->valid = true;
+    input->buttons = buttons;
+
+    uint64_t first = netplay_receive(frame);
+
+    // the oldest snapshot must stay available: wait for the peer when it is too far behind
+    struct pollfd pfd = { .fd = netplay->socket, .events = POLLIN };
+    uint32_t waited = 0;
+    while (frame >= netplay->remote_known + NETPLAY_MAX_ROLLBACK) {
+        netplay_send(frame);
+        if (poll(&pfd, 1, NETPLAY_POLL_MS) <= 0 && (waited += NETPLAY_POLL_MS) >= NETPLAY_TIMEOUT_MS) {
+            LOG_MESG(LOG_WARN, "Peer lost at frame %"PRIu64"", frame);
+            *rollback = frame;
+            return false;
+        }
+
+        const uint64_t late = netplay_receive(frame);
+        if (late < first)
+            first = late;
+    }
+
+    netplay_send(frame);
+
+    if (first < frame) {
+        netplay->rollbacks++;
+        netplay->rollback_frames += frame - first;
+        *rollback = first;
+    } else
+        *rollback = frame;
+
+    return true;
+}
+
+#endif
+
+uint8_t netplay_buttons(uint64_t frame) {
+    const struct netplay_input_s *local = &netplay->local[frame % NETPLAY_INPUT_RING];
+    const struct netplay_input_s *remote = &netplay->remote[frame % NETPLAY_INPUT_RING];
+
+    uint8_t remote_buttons = 0;
+    if (remote->valid && remote->frame == frame)
+        remote_buttons = remote->buttons;
+    else if (netplay->remote_known) // predict the peer keeps pressing the same buttons
+        remote_buttons = netplay->remote[(netplay->remote_known - 1) % NETPLAY_INPUT_RING].buttons;
+
+    struct netplay_snapshot_s *snapshot = &netplay->snapshots[frame % NETPLAY_MAX_ROLLBACK];
+    if (snapshot->frame == frame) {
+        snapshot->used = true;
+        snapshot->remote = remote_buttons;
+    }
+
+    return local->buttons | remote_buttons;
+}
+
+void netplay_save(uint64_t frame) {
+    struct netplay_snapshot_s *snapshot = &netplay->snapshots[frame % NETPLAY_MAX_ROLLBACK];
+    snapshot->frame = frame;
+    snapshot->used = false;
+    state_save(snapshot->state);
+}
+
+void netplay_load(uint64_t frame) {
+    const struct netplay_snapshot_s *snapshot = &netplay->snapshots[frame % NETPLAY_MAX_ROLLBACK];
+    if (snapshot->frame != frame) {
+        LOG_MESG(LOG_FATAL, "Netplay snapshot of frame %"PRIu64" is gone", frame);
+        exit(EXIT_FAILURE);
+    }
+    state_load(snapshot->state);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef NETPLAY
+#define NETPLAY
+
+#include <inttypes.h>
+
+bool netplay_start(uint16_t local_port, uint16_t remote_port);
+void netplay_stop();
+
+/* register the local buttons for `frame`, exchange inputs with the peer (waiting for it if it
+ * lags too far behind) and set `rollback` to the first frame that has to be simulated again */
+bool netplay_sync(uint64_t frame, uint8_t buttons, uint64_t *rollback);
+
+/* buttons both players pressed on `frame`, the remote ones being predicted until they arrive */
+uint8_t netplay_buttons(uint64_t frame);
+
+void netplay_save(uint64_t frame);
+void netplay_load(uint64_t frame);
+
+#endif
\ No newline at end of file
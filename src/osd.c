@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+#include "osd.h"
+#include "main.h"
+#include "fps.h"
+
+#define OSD_REFRESH_NS (500 * 1'000'000) // the numbers, the sparkline follows every frame
+#define OSD_HISTORY 128 // frame times kept, one sparkline bar each
+#define OSD_LINES 4
+#define OSD_LINE_LEN 41 // 160 pixels of FONT_WIDTH_SIZE
+
+#define OSD_FRAME_MS 16.74 // of the gameboy
+#define SPARKLINE_X 16
+#define SPARKLINE_BOTTOM 142
+#define SPARKLINE_HEIGHT 32 // one pixel per ms
+
+struct osd_s {
+    struct screen_s *screen;
+    bool shown;
+
+    uint64_t last_ns;
+    uint32_t frame_ns[OSD_HISTORY]; // a ring, oldest at `frame_next` once full
+    uint16_t frame_next;
+    uint16_t frame_count;
+
+    /* totals when the numbers were last refreshed */
+    uint64_t refresh_ns;
+    uint64_t instructions;
+    uint64_t slept_ns;
+    uint64_t frames;
+    uint64_t frames_total;
+
+    char lines[OSD_LINES][OSD_LINE_LEN];
+};
+
+static struct osd_s osd;
+
+static int osd_compare(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void osd_refresh(uint64_t now_ns, uint64_t instructions) {
+    const double seconds = (now_ns - osd.refresh_ns) / 1e9;
+    const uint64_t frames = osd.frames_total - osd.frames;
+    const uint64_t slept_ns = fps_slept_ns();
+
+    uint32_t sorted[OSD_HISTORY];
+    memcpy(sorted, osd.frame_ns, osd.frame_count * sizeof(*sorted));
+    qsort(sorted, osd.frame_count, sizeof(*sorted), osd_compare);
+
+    // the ppu frame length isn't the hardware's yet, so the speed is measured in frames
+    const double speed = frames / seconds / GAMEBOY_FRAME_RATE;
+    snprintf(osd.lines[0], OSD_LINE_LEN, "%.2f MHz (%.0f%%)", speed * GAMEBOY_HERTZ_CLOCK / 1e6, 100.0 * speed);
+    snprintf(osd.lines[1], OSD_LINE_LEN, "%.2f M instr/s", (instructions - osd.instructions) / seconds / 1e6);
+    snprintf(osd.lines[2], OSD_LINE_LEN, "frame p50 %.1f p99 %.1f ms", sorted[osd.frame_count / 2] / 1e6, sorted[osd.frame_count * 99 / 100] / 1e6);
+    snprintf(osd.lines[3], OSD_LINE_LEN, "sleep %.1f ms/frame", frames ? (slept_ns - osd.slept_ns) / 1e6 / frames : 0.0);
+
+    osd.refresh_ns = now_ns;
+    osd.instructions = instructions;
+    osd.slept_ns = slept_ns;
+    osd.frames = osd.frames_total;
+}
+
+static void osd_draw(struct screen_s *screen) {
+    for (uint8_t i = 0; i < OSD_LINES; i++)
+        screen_print(screen, 2, 2 + i * FONT_HEIGHT_SIZE, 0xFF, 0xFF, 0xFF, osd.lines[i]);
+
+    screen_draw_rect(screen, SPARKLINE_X, SPARKLINE_BOTTOM - SPARKLINE_HEIGHT, OSD_HISTORY, SPARKLINE_HEIGHT, 0x00, 0x00, 0x00);
+    for (uint16_t i = 0; i < osd.frame_count; i++) {
+        const uint32_t frame_ns = osd.frame_ns[(osd.frame_next + OSD_HISTORY - osd.frame_count + i) % OSD_HISTORY];
+        const double ms = frame_ns / 1e6;
+        const uint32_t h = ms >= SPARKLINE_HEIGHT ? SPARKLINE_HEIGHT : (ms < 1 ? 1 : ms);
+        if (ms <= OSD_FRAME_MS + 1)
+            screen_draw_rect(screen, SPARKLINE_X + i, SPARKLINE_BOTTOM - h, 1, h, 0x40, 0xD0, 0x40);
+        else
+            screen_draw_rect(screen, SPARKLINE_X + i, SPARKLINE_BOTTOM - h, 1, h, 0xE0, 0x40, 0x40);
+    }
+    // where a frame should end
+    screen_draw_rect(screen, SPARKLINE_X, SPARKLINE_BOTTOM - (uint32_t)OSD_FRAME_MS, OSD_HISTORY, 1, 0x80, 0x80, 0x80);
+}
+
+void osd_init(struct screen_s *screen) {
+    osd.screen = screen;
+    osd.last_ns = osd.refresh_ns = SDL_GetTicksNS();
+    osd.slept_ns = fps_slept_ns();
+}
+
+void osd_toggle() {
+    osd.shown = !osd.shown;
+    screen_set_overlay(osd.screen, osd.shown ? osd_draw : NULL);
+}
+
+void osd_frame(uint64_t instructions) {
+    const uint64_t now_ns = SDL_GetTicksNS();
+    osd.frame_ns[osd.frame_next] = now_ns - osd.last_ns > UINT32_MAX ? UINT32_MAX : now_ns - osd.last_ns;
+    osd.frame_next = (osd.frame_next + 1) % OSD_HISTORY;
+    if (osd.frame_count < OSD_HISTORY)
+        osd.frame_count++;
+    osd.last_ns = now_ns;
+    osd.frames_total++;
+
+    // kept up to date while hidden too, to show sensible numbers as soon as toggled
+    if (now_ns - osd.refresh_ns >= OSD_REFRESH_NS)
+        osd_refresh(now_ns, instructions);
+}
\ No newline at end of file
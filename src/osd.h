@@ -0,0 +1,15 @@
+#ifndef OSD
+#define OSD
+
+#include <inttypes.h>
+
+#include "screen.h"
+
+/* performance overlay drawn over the game screen, hidden until toggled */
+void osd_init(struct screen_s *screen);
+void osd_toggle();
+
+/* once per frame shown or not, with the running total of instructions of the core */
+void osd_frame(uint64_t instructions);
+
+#endif
\ No newline at end of file
@@ -1,30 +1,47 @@
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include <SDL3/SDL.h>
 
 #include "log.h"
 
 #include "ppu.h"
 #include "memory.h"
-#include "fps.h"
-#include "input.h"
+#include "prof.h"
 
 #define INTERRUPT_IF 0xFF0F
 #define INT_VBLANK  0b00'00'00'01
 
 #define VRAM_BASE_ADDR 0x8000
+#define VRAM_SIZE 0x2000
+#define TILE_COUNT 384
+#define TILE_SIZE 16
 
 #define LCDC_ADDR 0xFF40
     #define LCDC_PPU_ENABLE 0b10'00'00'00
+    #define LCDC_WINDOW_TILE_MAP_AREA 0b01'00'00'00
+    #define LCDC_WINDOW_ENABLE 0b00'10'00'00
     #define LCDC_BG_WD_TILE_DATA_AREA 0b00'01'00'00
         #define TILE_DATA_MODE_1 0x8000
         #define TILE_DATA_MODE_0 0x9000
     #define LCDC_BG_TILE_MAP_AREA 0b00'00'10'00
         #define TILE_MAP_AREA_0 0x9800
         #define TILE_MAP_AREA_1 0x9C00
+    #define LCDC_OBJ_SIZE 0b00'00'01'00
     #define LCDC_OBJ_ENABLE 0b00'00'00'10
     #define LCDC_BG_WD_ENABLE 0b00'00'00'01
 #define SCY_ADDR 0xFF42
 #define SCX_ADDR 0xFF43
 #define LY_ADDR 0xFF44
+#define BGP_ADDR 0xFF47
+#define OBP0_ADDR 0xFF48
+#define OBP1_ADDR 0xFF49
+#define WY_ADDR 0xFF4A
+#define WX_ADDR 0xFF4B
 
 #define OAM_SCAN 2
 #define OAM_SCAN_LEN (80 * 4)
@@ -34,6 +51,10 @@
 #define HORIZONTAL_BLANK_LEN (204 * 4)
 #define VERTICAL_BLANK 1
 #define VERTICAL_BLANK_LEN (4560 * 4)
+#define FRAME_LEN ((OAM_SCAN_LEN + DRAWING_PIXEL_LEN + HORIZONTAL_BLANK_LEN) * 154)
+
+#define OAM_BASE_ADDR 0xFE00
+#define OAM_COUNT 40
 
 struct oam_s {
     uint8_t y_pos;
@@ -42,198 +63,695 @@ struct oam_s {
     uint8_t flags;
 };
 
-uint8_t mode = OAM_SCAN;
-uint8_t ly = 0;
-uint8_t oam_validated = 0;
-uint8_t oam_to_be_displayed[10]; // 10 is the gameboy hardware limitation
+#define OBJ_FLAG_PRIORITY 0b10'00'00'00 // drawn behind background colors 1 to 3
+#define OBJ_FLAG_Y_FLIP 0b01'00'00'00
+#define OBJ_FLAG_X_FLIP 0b00'10'00'00
+#define OBJ_FLAG_PALETTE 0b00'01'00'00
+
+struct ppu_s {
+    uint64_t m_cycles_ellapsed;
+    uint8_t mode;
+    uint8_t ly;
+    uint8_t oam_validated;
+    uint8_t oam_to_be_displayed[10]; // 10 is the gameboy hardware limitation
+    bool lcd_off; // holding line 0 in horizontal blank until LCDC.7 is set again
+};
 
-static void draw_color(uint8_t pxl_color, struct screen_s *scr, uint32_t x, uint32_t y) {
-    switch (pxl_color) {
-        case 0x03:
-            screen_draw_pixel(scr, x, y, 0x9B, 0xBC, 0x0F);
-            break;
-        case 0x02:
-            screen_draw_pixel(scr, x, y, 0x8B, 0xAC, 0x0F);
-            break;
-        case 0x01:
-            screen_draw_pixel(scr, x, y, 0x30, 0x62, 0x30);
-            break;
-        case 0x00:
-            screen_draw_pixel(scr, x, y, 0x0F, 0x38, 0x0F);
-            break;
-        default:
-            LOG_MESG(LOG_FATAL, "Impossible color");
-            exit(EXIT_FAILURE);
-            break;
+static struct ppu_s ppu = { .mode = OAM_SCAN };
+static uint64_t lcd_off_m_cycles = 0; // for the host only, which still wants frames while the lcd is off
+
+struct theme_s {
+    const char *name;
+    uint32_t shades[4]; // from the lightest to the darkest
+};
+
+static const struct theme_s themes[] = {
+    { "dmg", { SCREEN_RGB(0x9B, 0xBC, 0x0F), SCREEN_RGB(0x8B, 0xAC, 0x0F), SCREEN_RGB(0x30, 0x62, 0x30), SCREEN_RGB(0x0F, 0x38, 0x0F) } },
+    { "pocket", { SCREEN_RGB(0xC4, 0xCF, 0xA1), SCREEN_RGB(0x8B, 0x95, 0x6D), SCREEN_RGB(0x4D, 0x53, 0x3C), SCREEN_RGB(0x1F, 0x1F, 0x1F) } },
+    { "grey", { SCREEN_RGB(0xFF, 0xFF, 0xFF), SCREEN_RGB(0xAA, 0xAA, 0xAA), SCREEN_RGB(0x55, 0x55, 0x55), SCREEN_RGB(0x00, 0x00, 0x00) } },
+};
+
+static const struct theme_s *theme = &themes[0];
+
+/* everything a line is drawn from, latched when the emulation reaches it */
+struct line_regs_s {
+    uint8_t ly;
+    uint8_t lcdc;
+    uint8_t scy;
+    uint8_t scx;
+    uint8_t wy;
+    uint8_t wx;
+    uint8_t objects_count;
+    struct oam_s objects[sizeof(ppu.oam_to_be_displayed)]; // in OAM order
+};
+
+/* a vram or palette write, or the drawing of the next line when `addr` is JOURNAL_LINE */
+struct journal_s {
+    uint16_t addr;
+    uint8_t value;
+};
+
+#define JOURNAL_LINE 0x0000 // a rom address, never written
+/* the quickest write, LD (HL), A, takes 2 of the FRAME_LEN m cycles of a frame, plus the line markers */
+#define JOURNAL_SIZE (FRAME_LEN / 2 + PPU_SCREEN_HEIGHT)
+
+/* a frame as the render thread replays it, from one vertical blank to the next */
+struct frame_log_s {
+    bool resync; // the render thread reloads its vram and palette registers from the copies below first
+    uint8_t vram[VRAM_SIZE];
+    uint8_t palette_regs[3];
+    const struct theme_s *theme;
+    uint8_t lines;
+    struct line_regs_s line_regs[PPU_SCREEN_HEIGHT];
+    uint32_t journal_len;
+    struct journal_s journal[JOURNAL_SIZE];
+};
+
+/* one log is filled by the emulation while the other one is drawn */
+static struct frame_log_s logs[2];
+static struct frame_log_s *log_fill = &logs[0];
+static bool journal_overflow = false;
+/* nothing is logged during headless frames, the next drawn frame starts with a resync instead */
+static bool log_active = false;
+
+static uint64_t vram_generation = 0; // bumped on every vram write, for the debug viewers
+
+struct renderer_s {
+    SDL_Thread *thread; // NULL when frames are drawn on the emulation thread
+    SDL_Mutex *mutex;
+    SDL_Condition *wake;
+    SDL_Condition *done;
+    struct frame_log_s *pending;
+    bool quit;
+};
+
+static struct renderer_s renderer = { 0 };
+
+/* for each line, the objects overlapping it (bit n for OAM entry n), kept up to date on OAM writes */
+static uint64_t line_objects[PPU_SCREEN_HEIGHT];
+static uint8_t objects_y[OAM_COUNT]; // y position each object was bucketed with
+static uint8_t objects_height = 0; // 0 when the buckets have to be rebuilt
+
+bool ppu_set_theme(const char *name) {
+    for (size_t i = 0; i < sizeof(themes) / sizeof(themes[0]); i++) {
+        if (!strcmp(themes[i].name, name)) {
+            theme = &themes[i]; // picked up by the next submitted frame
+            return true;
+        }
+    }
+    return false;
+}
+
+const uint32_t *ppu_get_shades() {
+    return theme->shades;
+}
+
+/*
+ * Render thread data, only touched by the emulation thread once ppu_render_wait() returned.
+ * None of it is part of the state: it is rebuilt from the frame logs.
+ */
+static uint8_t render_vram[VRAM_SIZE];
+static uint8_t render_palette_regs[3];
+static const struct theme_s *render_theme = NULL;
+
+/* BGP, OBP0 and OBP1 resolved to colors, rebuilt only when one of them or the theme changes */
+static uint32_t palettes[3][4];
+
+static uint32_t framebuffer[PPU_SCREEN_HEIGHT][PPU_SCREEN_WIDTH];
+
+static void palette_build(uint8_t index) {
+    for (uint8_t i = 0; i < 4; i++)
+        palettes[index][i] = render_theme->shades[(render_palette_regs[index] >> (i * 2)) & 0x03];
+}
+
+static uint8_t bg_line[PPU_SCREEN_WIDTH];
+
+#define LINE_TILES (PPU_SCREEN_WIDTH / 8 + 1) // a scrolled line straddles 21 tiles
+
+/* color index of the objects on the current line (0 when transparent) and their flags */
+static uint8_t obj_line[PPU_SCREEN_WIDTH];
+static uint8_t obj_flags_line[PPU_SCREEN_WIDTH];
+
+static uint8_t window_line; // the window only advances on lines where it is shown
+
+/* every tile of the vram decoded to one color index per byte, redecoded lazily once written */
+static uint8_t tiles[TILE_COUNT][8][8];
+static uint64_t tiles_valid[TILE_COUNT / 64] = { 0 };
+
+/* bumped on every write to a tile or to a row of one of the two tile maps */
+static uint32_t tile_generations[TILE_COUNT];
+static uint32_t map_row_generations[2][32];
+
+/* what a line was drawn from: while it doesn't change, the framebuffer line is still right */
+struct line_signature_s {
+    struct line_regs_s regs;
+    uint8_t window_line;
+    uint8_t palette_regs[3];
+    const struct theme_s *theme;
+    uint32_t bg_map_generation;
+    uint32_t window_map_generation;
+    uint64_t tiles_generation; // sum of the generations of the tiles read, they only ever grow
+};
+
+static struct line_signature_s line_signatures[PPU_SCREEN_HEIGHT]; // zeroed: the theme never matches
+static uint64_t lines_reused = 0, lines_drawn = 0;
+
+/* one row of a 2bpp tile: bit 7 of both bytes is the leftmost pixel */
+static void tile_decode_row(uint8_t lsb, uint8_t msb, uint8_t *row) {
+#ifdef __BMI2__
+    // spread each bit into its own byte, then reverse the bytes so the leftmost pixel comes first
+    const uint64_t pixels = __builtin_bswap64(_pdep_u64(lsb, 0x0101010101010101) | _pdep_u64(msb, 0x0202020202020202));
+    memcpy(row, &pixels, sizeof(pixels));
+#else
+    for (uint8_t x = 0; x < 8; x++)
+        row[x] = ((lsb >> (7 - x)) & 0x01) | (((msb >> (7 - x)) & 0x01) << 1);
+#endif
+}
+
+static const uint8_t (*tile_get(uint16_t index))[8] {
+    if (!(tiles_valid[index / 64] & (1ULL << (index % 64)))) {
+        const uint8_t *data = render_vram + index * TILE_SIZE;
+        for (uint8_t y = 0; y < 8; y++)
+            tile_decode_row(data[y * 2], data[y * 2 + 1], tiles[index][y]);
+        tiles_valid[index / 64] |= 1ULL << (index % 64);
     }
+
+    return tiles[index];
 }
 
-static uint8_t tile_get_less_significant_bit(const uint8_t *tile, uint8_t x, uint8_t y) {
-    uint8_t byte = *(tile + y * 2);
-    return (byte & (1 << (7 - x))) >> (7 - x);
+static void render_vram_write(uint16_t addr, uint8_t value) {
+    const uint16_t offset = addr - VRAM_BASE_ADDR;
+    render_vram[offset] = value;
+    if (offset < TILE_COUNT * TILE_SIZE) {
+        tiles_valid[offset / TILE_SIZE / 64] &= ~(1ULL << ((offset / TILE_SIZE) % 64));
+        tile_generations[offset / TILE_SIZE]++;
+    } else
+        map_row_generations[offset >= TILE_MAP_AREA_1 - VRAM_BASE_ADDR][(offset / 32) % 32]++;
 }
 
-static uint8_t tile_get_most_significant_bit(const uint8_t *tile, uint8_t x, uint8_t y) {
-    uint8_t byte = *(tile + y * 2 + 1);
-    return ((byte & (1 << (7 - x))) >> (7 - x)) << 1;
+/* tiles 0-255 start at 0x8000 in unsigned mode, and -128-127 around 0x9000 in signed mode */
+static uint16_t tile_data_index(uint8_t lcdc, uint8_t tile) {
+    if (lcdc & LCDC_BG_WD_TILE_DATA_AREA)
+        return tile;
+    return (uint16_t)(256 + (int8_t)tile);
 }
 
-static void tile_draw(struct screen_s *tiles_screen) {
-    uint8_t *vram = memory_special_get_vram();
+/* copy `count` tile rows of a 32 tiles wide map row into `row`, starting at map column `column` */
+static void map_row_fetch(uint8_t lcdc, const uint8_t *map_row, uint8_t column, uint8_t count, uint8_t tile_y, uint8_t *row) {
+    for (uint8_t i = 0; i < count; i++)
+        memcpy(row + i * 8, tile_get(tile_data_index(lcdc, map_row[(column + i) % 32]))[tile_y], 8);
+}
 
-    for (uint16_t i = 0; i < 384; i++) {
+static void objects_bucket(uint8_t index, uint8_t y_pos, bool set) {
+    // the y position is the screen line + 16
+    for (uint8_t i = 0; i < objects_height; i++) {
+        const int16_t line = y_pos - 16 + i;
+        if (line < 0 || line >= PPU_SCREEN_HEIGHT)
+            continue;
+
+        if (set)
+            line_objects[line] |= 1ULL << index;
+        else
+            line_objects[line] &= ~(1ULL << index);
+    }
+}
 
-        const uint16_t base_x = ((i % 16) * 8) + (i % 16);
-        const uint16_t base_y = ((i / 16) * 8) + (i / 16);
+static void objects_rebuild(uint8_t height) {
+    const struct oam_s *oam = (const struct oam_s *)memory_special_get_oam_area();
 
-        for (uint8_t j = 0; j < 8; j++)
-            for (uint8_t k = 0; k < 8; k++)
-                draw_color(tile_get_less_significant_bit(vram + (i * 16), k, j) + tile_get_most_significant_bit(vram + (i * 16), k, j), tiles_screen, k + base_x, j + base_y);
+    memset(line_objects, 0, sizeof(line_objects));
+    objects_height = height;
+    for (uint8_t i = 0; i < OAM_COUNT; i++) {
+        objects_y[i] = oam[i].y_pos;
+        objects_bucket(i, objects_y[i], true);
     }
+}
+
+void ppu_oam_written(uint16_t addr) {
+    const uint16_t offset = addr - OAM_BASE_ADDR;
+    if (!objects_height || offset % sizeof(struct oam_s)) // only the y position moves an object between lines
+        return;
 
-    screen_present(tiles_screen);
+    const uint8_t index = offset / sizeof(struct oam_s);
+    objects_bucket(index, objects_y[index], false);
+    objects_y[index] = memory_special_get_oam_area()[offset];
+    objects_bucket(index, objects_y[index], true);
 }
 
-static void map_0_draw(struct screen_s *map_screen) {
-    const uint8_t bscx = memory_read_8(SCX_ADDR);
-    const uint8_t bscy = memory_read_8(SCY_ADDR);
+void ppu_oam_invalidate() {
+    objects_height = 0;
+}
+
+/* select the first 10 objects of the line in OAM order, like the hardware does */
+static void objects_select(uint8_t lcdc) {
+    const uint8_t height = lcdc & LCDC_OBJ_SIZE ? 16 : 8;
+    if (height != objects_height)
+        objects_rebuild(height);
+
+    uint64_t objects = line_objects[ppu.ly];
+    ppu.oam_validated = 0;
+    while (objects && ppu.oam_validated < sizeof(ppu.oam_to_be_displayed)) {
+        ppu.oam_to_be_displayed[ppu.oam_validated++] = __builtin_ctzll(objects);
+        objects &= objects - 1;
+    }
+}
+
+static void render_objects_line(const struct line_regs_s *line) {
+    memset(obj_line, 0, sizeof(obj_line));
+    if (!(line->lcdc & LCDC_OBJ_ENABLE))
+        return;
+
+    const uint8_t height = line->lcdc & LCDC_OBJ_SIZE ? 16 : 8;
+
+    // the smallest x is drawn on top, then the first in OAM: sort the selection (already in OAM order) by x
+    uint8_t order[sizeof(line->objects) / sizeof(line->objects[0])];
+    for (uint8_t i = 0; i < line->objects_count; i++) {
+        uint8_t j = i;
+        for (; j > 0 && line->objects[order[j - 1]].x_pos > line->objects[i].x_pos; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    // from the top object down, a pixel is only taken by the first object not transparent there
+    for (uint8_t i = 0; i < line->objects_count; i++) {
+        const struct oam_s *obj = &line->objects[order[i]];
 
-    uint8_t *vram = memory_special_get_vram();
+        uint8_t row = line->ly + 16 - obj->y_pos;
+        if (obj->flags & OBJ_FLAG_Y_FLIP)
+            row = height - 1 - row;
 
-    for (uint8_t i = 0; i < 32; i++) {
-        for (uint8_t j = 0; j < 32; j++) {
-            const uint32_t base_x = j * 8;
-            const uint32_t base_y = i * 8;
-            const uint8_t tile = *(vram + (TILE_MAP_AREA_0 - VRAM_BASE_ADDR) + j + i * 32);
-            for (uint8_t k = 0; k < 8; k++)
-                for (uint8_t l = 0; l < 8; l++)
-                    draw_color(tile_get_less_significant_bit(vram + (tile * 16), l, k) + tile_get_most_significant_bit(vram + (tile * 16), l, k), map_screen, l + base_x, k + base_y);
+        // objects always use the 0x8000 addressing, 8x16 ones ignore the lowest bit of the tile index
+        const uint8_t tile_index = (height == 16 ? obj->tile_index & 0xFE : obj->tile_index) + row / 8;
+        const uint8_t *pixels = tile_get(tile_index)[row % 8];
+
+        for (uint8_t x = 0; x < 8; x++) {
+            const int16_t screen_x = obj->x_pos - 8 + x;
+            if (screen_x < 0 || screen_x >= PPU_SCREEN_WIDTH)
+                continue;
+
+            const uint8_t color = pixels[obj->flags & OBJ_FLAG_X_FLIP ? 7 - x : x];
+            if (!color || obj_line[screen_x])
+                continue;
+
+            obj_line[screen_x] = color;
+            obj_flags_line[screen_x] = obj->flags;
         }
     }
+}
+
+static bool window_visible(const struct line_regs_s *line) {
+    return (line->lcdc & LCDC_BG_WD_ENABLE) && (line->lcdc & LCDC_WINDOW_ENABLE) && line->ly >= line->wy && line->wx < PPU_SCREEN_WIDTH + 7;
+}
+
+static void render_background_line(const struct line_regs_s *line) {
+    const uint8_t lcdc = line->lcdc;
+    if (!(lcdc & LCDC_BG_WD_ENABLE)) {
+        memset(bg_line, 0, sizeof(bg_line));
+        return;
+    }
+
+    const uint8_t scx = line->scx;
+    const uint8_t wx = line->wx;
 
-    for (uint8_t scx = bscx, i = 0; i < 160; i += 8, scx += 8)
-        screen_draw_pixel(map_screen, scx, bscy, 255, 0, 0);
+    uint8_t row[LINE_TILES * 8];
 
-    for (uint8_t scx = bscx, i = 0; i < 160; i += 8, scx += 8)
-        screen_draw_pixel(map_screen, scx, (uint8_t)(bscy + 144), 255, 0, 0);
+    const uint8_t y = line->scy + line->ly;
+    const uint8_t *map_row = render_vram + (lcdc & LCDC_BG_TILE_MAP_AREA ? TILE_MAP_AREA_1 : TILE_MAP_AREA_0) - VRAM_BASE_ADDR + (y / 8) * 32;
+    map_row_fetch(lcdc, map_row, scx / 8, LINE_TILES, y % 8, row);
+    memcpy(bg_line, row + scx % 8, PPU_SCREEN_WIDTH);
 
-    for (uint8_t scy = bscy, i = 0; i < 144; i += 8, scy += 8)
-        screen_draw_pixel(map_screen, bscx, scy, 255, 0, 0);
+    if (!window_visible(line))
+        return;
+
+    // the window starts at WX - 7 on screen, its first pixels are cut when WX < 7
+    const uint8_t start = wx < 7 ? 0 : wx - 7;
+    const uint8_t skip = wx < 7 ? 7 - wx : 0;
+    const uint8_t count = PPU_SCREEN_WIDTH - start;
 
-    for (uint8_t scy = bscy, i = 0; i < 144; i += 8, scy += 8)
-        screen_draw_pixel(map_screen, (uint8_t)(bscx + 160), scy, 255, 0, 0);
+    const uint8_t *window_row = render_vram + (lcdc & LCDC_WINDOW_TILE_MAP_AREA ? TILE_MAP_AREA_1 : TILE_MAP_AREA_0) - VRAM_BASE_ADDR + (window_line / 8) * 32;
+    map_row_fetch(lcdc, window_row, 0, (skip + count + 7) / 8, window_line % 8, row);
+    memcpy(bg_line + start, row + skip, count);
 
-    screen_present(map_screen);
+    window_line++;
 }
 
-void ppu_run(uint8_t m_cycles, struct screen_s *screen, struct screen_s *tiles_screen, struct screen_s *map_0) {
-    static uint64_t m_cycles_ellapsed = 0;
+static void line_signature(const struct line_regs_s *line, struct line_signature_s *signature) {
+    memset(signature, 0, sizeof(*signature)); // compared with memcmp, padding included
+    signature->regs = *line;
+    signature->window_line = window_line;
+    memcpy(signature->palette_regs, render_palette_regs, sizeof(render_palette_regs));
+    signature->theme = render_theme;
+
+    const uint8_t lcdc = line->lcdc;
+    if (lcdc & LCDC_BG_WD_ENABLE) {
+        const uint8_t y = line->scy + line->ly;
+        const bool bg_map = lcdc & LCDC_BG_TILE_MAP_AREA;
+        const uint8_t *map_row = render_vram + (bg_map ? TILE_MAP_AREA_1 : TILE_MAP_AREA_0) - VRAM_BASE_ADDR + (y / 8) * 32;
+        signature->bg_map_generation = map_row_generations[bg_map][y / 8];
+        for (uint8_t i = 0; i < LINE_TILES; i++)
+            signature->tiles_generation += tile_generations[tile_data_index(lcdc, map_row[(line->scx / 8 + i) % 32])];
+
+        if (window_visible(line)) {
+            const bool window_map = lcdc & LCDC_WINDOW_TILE_MAP_AREA;
+            const uint8_t *window_row = render_vram + (window_map ? TILE_MAP_AREA_1 : TILE_MAP_AREA_0) - VRAM_BASE_ADDR + (window_line / 8) * 32;
+            signature->window_map_generation = map_row_generations[window_map][window_line / 8];
+            for (uint8_t i = 0; i < LINE_TILES; i++)
+                signature->tiles_generation += tile_generations[tile_data_index(lcdc, window_row[i])];
+        }
+    }
+
+    if (lcdc & LCDC_OBJ_ENABLE) {
+        for (uint8_t i = 0; i < line->objects_count; i++) {
+            // both halves of an 8x16 object, whichever row is shown
+            const uint8_t tile_index = line->objects[i].tile_index;
+            signature->tiles_generation += tile_generations[tile_index];
+            if (lcdc & LCDC_OBJ_SIZE)
+                signature->tiles_generation += tile_generations[tile_index ^ 0x01];
+        }
+    }
+}
 
-    if (!(memory_read_8(LCDC_ADDR) & LCDC_PPU_ENABLE))
+static void render_line(const struct line_regs_s *line) {
+    struct line_signature_s signature;
+    line_signature(line, &signature);
+    if (!memcmp(&signature, &line_signatures[line->ly], sizeof(signature))) {
+        lines_reused++;
+        if (window_visible(line))
+            window_line++;
         return;
+    }
+    line_signatures[line->ly] = signature;
+    lines_drawn++;
 
-    m_cycles_ellapsed += m_cycles;
+    render_background_line(line);
+    render_objects_line(line);
 
-    switch (mode) {
-        case OAM_SCAN:
-            if (m_cycles_ellapsed >= OAM_SCAN_LEN) {
-                // Do OAM scan
-                // inside `oam_to_be_displayed`, the maximum 10 object to be displayed will be stored
-                for (uint8_t i = 0; i < 40; i++) { // there is 40 tiles in the OAM area
-                    struct oam_s *oam = (struct oam_s *)memory_special_get_oam_area();
-                    if (oam[i].y_pos > 8 + ly && oam[i].y_pos <= 16 + ly && oam_validated < sizeof(oam_to_be_displayed)) {
-                        oam_to_be_displayed[oam_validated] = i;
-                        oam_validated++;
-                    }
-                }
-
-                m_cycles_ellapsed -= OAM_SCAN_LEN;
-                mode = DRAWING_PIXEL;
-                // screen_clear(screen);
-            }
+    uint32_t *dst = framebuffer[line->ly];
+    for (uint8_t x = 0; x < PPU_SCREEN_WIDTH; x++) {
+        const bool obj_visible = obj_line[x] && !((obj_flags_line[x] & OBJ_FLAG_PRIORITY) && bg_line[x]);
+        dst[x] = obj_visible ? palettes[(obj_flags_line[x] & OBJ_FLAG_PALETTE) ? 2 : 1][obj_line[x]] : palettes[0][bg_line[x]];
+    }
+}
+
+/* replay a frame log: apply the writes in order, drawing each line where it was latched */
+static void render_frame(const struct frame_log_s *log) {
+    if (log->resync) {
+        memcpy(render_vram, log->vram, VRAM_SIZE);
+        memset(tiles_valid, 0, sizeof(tiles_valid));
+        memset(line_signatures, 0, sizeof(line_signatures));
+        memcpy(render_palette_regs, log->palette_regs, sizeof(render_palette_regs));
+    }
+    if (log->resync || log->theme != render_theme) {
+        render_theme = log->theme;
+        for (uint8_t i = 0; i < 3; i++)
+            palette_build(i);
+    }
+
+    window_line = 0;
+    uint8_t line = 0;
+    for (uint32_t i = 0; i < log->journal_len; i++) {
+        const struct journal_s *entry = &log->journal[i];
+        if (entry->addr == JOURNAL_LINE)
+            render_line(&log->line_regs[line++]);
+        else if (entry->addr >= BGP_ADDR && entry->addr <= OBP1_ADDR) {
+            render_palette_regs[entry->addr - BGP_ADDR] = entry->value;
+            palette_build(entry->addr - BGP_ADDR);
+        } else
+            render_vram_write(entry->addr, entry->value);
+    }
+}
+
+static int render_thread(void *data) {
+    (void)data;
+
+    SDL_LockMutex(renderer.mutex);
+    while (true) {
+        while (!renderer.pending && !renderer.quit)
+            SDL_WaitCondition(renderer.wake, renderer.mutex);
+        if (!renderer.pending)
             break;
-        case DRAWING_PIXEL:
-            if (m_cycles_ellapsed >= DRAWING_PIXEL_LEN) {
 
-                uint8_t lcdc = memory_read_8(LCDC_ADDR);
-                uint8_t *vram = memory_special_get_vram();
+        struct frame_log_s *log = renderer.pending;
+        SDL_UnlockMutex(renderer.mutex);
+        render_frame(log);
+        SDL_LockMutex(renderer.mutex);
+
+        renderer.pending = NULL;
+        SDL_BroadcastCondition(renderer.done);
+    }
+    SDL_UnlockMutex(renderer.mutex);
+
+    return 0;
+}
+
+bool ppu_init() {
+    renderer.mutex = SDL_CreateMutex();
+    renderer.wake = SDL_CreateCondition();
+    renderer.done = SDL_CreateCondition();
+    if (renderer.mutex && renderer.wake && renderer.done)
+        renderer.thread = SDL_CreateThread(render_thread, "ppu render", NULL);
+
+    if (!renderer.thread) {
+        LOG_MESG(LOG_WARN, "Couldn't start the render thread: %s", SDL_GetError());
+        ppu_shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void ppu_shutdown() {
+    if (renderer.thread) {
+        SDL_LockMutex(renderer.mutex);
+        renderer.quit = true;
+        SDL_SignalCondition(renderer.wake);
+        SDL_UnlockMutex(renderer.mutex);
+        SDL_WaitThread(renderer.thread, NULL);
+    }
+
+    if (renderer.done)
+        SDL_DestroyCondition(renderer.done);
+    if (renderer.wake)
+        SDL_DestroyCondition(renderer.wake);
+    if (renderer.mutex)
+        SDL_DestroyMutex(renderer.mutex);
+    renderer = (struct renderer_s){ 0 };
+}
+
+void ppu_line_stats(uint64_t *reused, uint64_t *drawn) {
+    *reused = lines_reused;
+    *drawn = lines_drawn;
+}
+
+void ppu_render_wait() {
+    if (!renderer.thread)
+        return;
+
+    SDL_LockMutex(renderer.mutex);
+    while (renderer.pending)
+        SDL_WaitCondition(renderer.done, renderer.mutex);
+    SDL_UnlockMutex(renderer.mutex);
+}
+
+static void render_submit(struct frame_log_s *log) {
+    if (!renderer.thread) {
+        render_frame(log);
+        return;
+    }
+
+    SDL_LockMutex(renderer.mutex);
+    while (renderer.pending)
+        SDL_WaitCondition(renderer.done, renderer.mutex);
+    renderer.pending = log;
+    SDL_SignalCondition(renderer.wake);
+    SDL_UnlockMutex(renderer.mutex);
+}
+
+/* start the log over, with a copy of the vram and palette registers when the render thread copies can't be trusted */
+static void log_reset(bool resync) {
+    log_fill->resync = resync;
+    if (resync) {
+        memcpy(log_fill->vram, memory_special_get_vram(), VRAM_SIZE);
+        for (uint8_t i = 0; i < 3; i++)
+            log_fill->palette_regs[i] = memory_read_8(BGP_ADDR + i);
+    }
+    log_fill->lines = 0;
+    log_fill->journal_len = 0;
+    journal_overflow = false;
+}
+
+static void journal_push(uint16_t addr, uint8_t value) {
+    if (!log_active)
+        return;
 
-                /* draw background */
-                if (lcdc & LCDC_BG_WD_ENABLE) {
-                    const uint16_t base_map_area = lcdc & LCDC_BG_TILE_MAP_AREA ? TILE_MAP_AREA_1 - VRAM_BASE_ADDR : TILE_MAP_AREA_0 - VRAM_BASE_ADDR;
-                    for (uint8_t i = 0; i < screen_get_width(screen); i++) {
-                        const uint8_t x = memory_read_8(SCX_ADDR) + i;
-                        const uint8_t y = memory_read_8(SCY_ADDR) + ly;
+    // keep room for the line markers, an overflowing frame is drawn stale and the next one resynchronized
+    if (log_fill->journal_len >= JOURNAL_SIZE - PPU_SCREEN_HEIGHT) {
+        if (!journal_overflow)
+            LOG_MESG(LOG_WARN, "The ppu journal overflowed, this frame is drawn stale");
+        journal_overflow = true;
+        return;
+    }
 
-                        const uint8_t tile = *(vram + base_map_area + ((x / 8) + ((y / 8) * 32)));
+    log_fill->journal[log_fill->journal_len++] = (struct journal_s){ .addr = addr, .value = value };
+}
 
-                        draw_color(tile_get_less_significant_bit(vram + (tile * 16), x % 8, y % 8) + tile_get_most_significant_bit(vram + (tile * 16), x % 8, y % 8), screen, i, ly);
-                    }
-                }
+void ppu_vram_written(uint16_t addr) {
+    vram_generation++;
+    journal_push(addr, memory_special_get_vram()[addr - VRAM_BASE_ADDR]);
+}
 
-                /* draw obj */
-                if (lcdc & LCDC_OBJ_ENABLE) {
-                    struct oam_s *oam = (struct oam_s *)memory_special_get_oam_area();
-                    for (uint8_t i = 0; i < oam_validated; i++) {
-                        // first get the line of the tile to be displayed!
-                        const uint8_t y_pos = 7 - (oam[i].y_pos - (9 + ly));
+void ppu_palette_written(uint16_t addr) {
+    journal_push(addr, memory_read_8(addr));
+}
 
-                        // then get the first x pos on the screen to be displayed
-                        const int16_t x_pos16 = oam[i].x_pos - 8;
+static void line_latch() {
+    if (log_fill->lines >= PPU_SCREEN_HEIGHT)
+        return;
 
-                        const uint8_t tile_index = oam[i].tile_index;
+    const struct oam_s *oam = (const struct oam_s *)memory_special_get_oam_area();
+    struct line_regs_s *line = &log_fill->line_regs[log_fill->lines++];
+
+    line->ly = ppu.ly;
+    line->lcdc = memory_read_8(LCDC_ADDR);
+    line->scy = memory_read_8(SCY_ADDR);
+    line->scx = memory_read_8(SCX_ADDR);
+    line->wy = memory_read_8(WY_ADDR);
+    line->wx = memory_read_8(WX_ADDR);
+    line->objects_count = ppu.oam_validated;
+    for (uint8_t i = 0; i < ppu.oam_validated; i++)
+        line->objects[i] = oam[ppu.oam_to_be_displayed[i]];
+    // the unused slots are part of the line signature
+    memset(line->objects + ppu.oam_validated, 0, sizeof(line->objects) - ppu.oam_validated * sizeof(line->objects[0]));
+
+    log_fill->journal[log_fill->journal_len++] = (struct journal_s){ .addr = JOURNAL_LINE };
+}
 
-                        for (int16_t x = 0; x < 8; x++) { // tiles are always 8 bits wide
-                            const int16_t x_pxl = x_pos16 + x;
-                            if (x_pxl < 0) // this is offscreen (on the left)
-                                continue;
+/* hand a drawn frame to the render thread, a headless one only leaves the render thread copies behind */
+static void frame_end(bool render) {
+    if (!render) {
+        log_active = false;
+        return;
+    }
 
-                            if (x_pxl >= screen_get_width(screen)) // this is offscreen (on the right)
-                                continue;
+    log_fill->theme = theme;
+    render_submit(log_fill);
+    log_fill = log_fill == &logs[0] ? &logs[1] : &logs[0];
+    log_active = !journal_overflow;
+    log_reset(false);
+}
+
+bool ppu_run(uint8_t m_cycles, bool render) {
+    PROF_SCOPE(PROF_PPU);
+
+    // the snapshot already holds the writes made since the last frame ended
+    if (render && !log_active) {
+        log_reset(true);
+        log_active = true;
+    }
+
+    if (!(memory_read_8(LCDC_ADDR) & LCDC_PPU_ENABLE)) {
+        if (!ppu.lcd_off) {
+            ppu.lcd_off = true;
+            ppu.m_cycles_ellapsed = 0;
+            ppu.ly = 0;
+            ppu.mode = HORIZONTAL_BLANK;
+            memory_write_8(LY_ADDR, ppu.ly);
+        }
 
-                            // fetch tile color data for this pixel!
-                            uint8_t *tile = vram + tile_index * 16; // one tile is 16 bytes
-                            uint8_t pxl_color = (*(tile + (y_pos * 2) + 1)) & (1 << (8 - x)) ? 0x02 : 0;
-                            pxl_color |= (*(tile + (y_pos * 2))) & (1 << (8 - x)) ? 0x01 : 0;
+        // keep reporting frames so the host can still poll inputs and pace itself
+        lcd_off_m_cycles += m_cycles;
+        if (lcd_off_m_cycles >= FRAME_LEN) {
+            lcd_off_m_cycles -= FRAME_LEN;
+            frame_end(render);
+            return true;
+        }
+        return false;
+    }
+
+    // turned back on, line 0 starts over
+    if (ppu.lcd_off) {
+        ppu.lcd_off = false;
+        ppu.mode = OAM_SCAN;
+        lcd_off_m_cycles = 0;
+    }
 
-                            draw_color(pxl_color, screen, x_pos16, ly);
-                        }
-                    }
-                }
+    ppu.m_cycles_ellapsed += m_cycles;
 
-                m_cycles_ellapsed -= DRAWING_PIXEL_LEN;
-                mode = HORIZONTAL_BLANK;
+    switch (ppu.mode) {
+        case OAM_SCAN:
+            if (ppu.m_cycles_ellapsed >= OAM_SCAN_LEN) {
+                // Do OAM scan
+                // inside `oam_to_be_displayed`, the maximum 10 object to be displayed will be stored
+                if (render)
+                    objects_select(memory_read_8(LCDC_ADDR));
+                else
+                    ppu.oam_validated = 0;
+
+                ppu.m_cycles_ellapsed -= OAM_SCAN_LEN;
+                ppu.mode = DRAWING_PIXEL;
+                // screen_clear(screen);
+            }
+            break;
+        case DRAWING_PIXEL:
+            if (ppu.m_cycles_ellapsed >= DRAWING_PIXEL_LEN) {
+
+                /* headless: keep the timing, skip the pixels */
+                if (render)
+                    line_latch();
+
+                ppu.m_cycles_ellapsed -= DRAWING_PIXEL_LEN;
+                ppu.mode = HORIZONTAL_BLANK;
             }
             break;
         case HORIZONTAL_BLANK:
-            if (m_cycles_ellapsed >= HORIZONTAL_BLANK_LEN) {
-                m_cycles_ellapsed -= HORIZONTAL_BLANK_LEN;
+            if (ppu.m_cycles_ellapsed >= HORIZONTAL_BLANK_LEN) {
+                ppu.m_cycles_ellapsed -= HORIZONTAL_BLANK_LEN;
                 /* make horizontal sync (or maybe only vertical sync ?)*/
-                ly++;
-                memory_write_8(LY_ADDR, ly);
-                if (ly >= 144) {
-                    // screen_present(screen);
+                ppu.ly++;
+                memory_write_8(LY_ADDR, ppu.ly);
+                if (ppu.ly >= PPU_SCREEN_HEIGHT) {
                     memory_write_8(INTERRUPT_IF, memory_read_8(INTERRUPT_IF) | INT_VBLANK);
-                    mode = VERTICAL_BLANK;
-                    input_load();
-                    fps_wait(16.74 * 1'000'000);
-                    screen_present(screen);
-                    if (tiles_screen)
-                        tile_draw(tiles_screen);
-                    if (map_0)
-                        map_0_draw(map_0);
+                    ppu.mode = VERTICAL_BLANK;
+                    frame_end(render);
+                    return true;
                 } else
-                    mode = OAM_SCAN;
+                    ppu.mode = OAM_SCAN;
             }
             break;
         case VERTICAL_BLANK:
-            if (m_cycles_ellapsed >= OAM_SCAN_LEN + DRAWING_PIXEL_LEN + HORIZONTAL_BLANK_LEN) {
-                m_cycles_ellapsed -= OAM_SCAN_LEN + DRAWING_PIXEL_LEN + HORIZONTAL_BLANK_LEN;
-                ly = (ly + 1) % 154;
-                memory_write_8(LY_ADDR, ly);
-                if (!ly)
-                    mode = OAM_SCAN;
+            if (ppu.m_cycles_ellapsed >= OAM_SCAN_LEN + DRAWING_PIXEL_LEN + HORIZONTAL_BLANK_LEN) {
+                ppu.m_cycles_ellapsed -= OAM_SCAN_LEN + DRAWING_PIXEL_LEN + HORIZONTAL_BLANK_LEN;
+                ppu.ly = (ppu.ly + 1) % 154;
+                memory_write_8(LY_ADDR, ppu.ly);
+                if (!ppu.ly)
+                    ppu.mode = OAM_SCAN;
             }
             break;
     }
+
+    return false;
+}
+
+size_t ppu_state_size() {
+    return sizeof(struct ppu_s);
+}
+
+void ppu_state_save(uint8_t *buffer) {
+    memcpy(buffer, &ppu, sizeof(struct ppu_s));
 }
+
+void ppu_state_load(const uint8_t *buffer) {
+    memcpy(&ppu, buffer, sizeof(struct ppu_s));
+    // the vram, oam and palettes were restored as well
+    ppu_oam_invalidate();
+    log_active = false;
+    vram_generation++;
+}
+
+uint64_t ppu_vram_generation() {
+    return vram_generation;
+}
+
+const uint32_t *ppu_get_framebuffer() {
+    return &framebuffer[0][0];
+}
\ No newline at end of file
@@ -2,9 +2,37 @@
 #define PPU
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "screen.h"
 
-void ppu_run(uint8_t m_cycles, struct screen_s *screen, struct screen_s *tiles_screen, struct screen_s *map_0);
+#define PPU_SCREEN_WIDTH 160
+#define PPU_SCREEN_HEIGHT 144
+
+/* starts the render thread, without it frames are drawn on the emulation thread */
+bool ppu_init();
+void ppu_shutdown();
+
+/* returns true when the frame is complete (entering vertical blank), runs headless when not rendering */
+bool ppu_run(uint8_t m_cycles, bool render);
+const uint32_t *ppu_get_framebuffer(); // PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT pixels, see SCREEN_RGB
+/* a completed frame is drawn asynchronously, wait for it before reading the framebuffer */
+void ppu_render_wait();
+/* lines whose inputs didn't change since the previous frame, and were not drawn again; read after ppu_render_wait() */
+void ppu_line_stats(uint64_t *reused, uint64_t *drawn);
+void ppu_vram_written(uint16_t addr);
+void ppu_oam_written(uint16_t addr);
+void ppu_oam_invalidate();
+void ppu_palette_written(uint16_t addr);
+/* selects the colors the 4 shades are rendered with ("dmg", "pocket" or "grey"), returns false for an unknown theme */
+bool ppu_set_theme(const char *name);
+/* the 4 colors of the theme, from the lightest to the darkest */
+const uint32_t *ppu_get_shades();
+/* changes whenever the vram is written or loaded */
+uint64_t ppu_vram_generation();
+
+size_t ppu_state_size();
+void ppu_state_save(uint8_t *buffer);
+void ppu_state_load(const uint8_t *buffer);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "prof.h"
+
+#ifdef VGE_PROFILE
+
+#define PROF_BUCKETS 48 // of frames by the power of two just above their tick count
+
+/* the zones, then the whole frame */
+struct prof_histogram_s {
+    uint64_t frames;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[PROF_BUCKETS];
+};
+
+static const char *names[PROF_ZONES + 1] = { "cpu", "memory", "ppu", "timer", "input", "present", "sleep", "frame" };
+
+struct prof_s prof;
+
+static struct prof_histogram_s histograms[PROF_ZONES + 1];
+static uint64_t frame_start;
+static uint64_t start_tsc, start_ns;
+
+void prof_init() {
+    memset(histograms, 0, sizeof(histograms));
+    for (uint8_t i = 0; i <= PROF_ZONES; i++)
+        histograms[i].min = UINT64_MAX;
+    start_ns = SDL_GetTicksNS();
+    start_tsc = frame_start = __rdtsc();
+}
+
+static void prof_histogram_add(struct prof_histogram_s *histogram, uint64_t ticks) {
+    uint8_t bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    if (bucket >= PROF_BUCKETS)
+        bucket = PROF_BUCKETS - 1;
+
+    histogram->frames++;
+    histogram->total += ticks;
+    histogram->buckets[bucket]++;
+    if (ticks < histogram->min)
+        histogram->min = ticks;
+    if (ticks > histogram->max)
+        histogram->max = ticks;
+}
+
+void prof_frame() {
+    const uint64_t now = __rdtsc();
+    for (uint8_t i = 0; i < PROF_ZONES; i++) {
+        prof_histogram_add(&histograms[i], prof.frame[i]);
+        prof.frame[i] = 0;
+    }
+    prof_histogram_add(&histograms[PROF_ZONES], now - frame_start);
+    frame_start = now;
+}
+
+/* upper bound of the bucket holding the given fraction of the frames, at most the max */
+static uint64_t prof_percentile(const struct prof_histogram_s *histogram, double fraction) {
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < PROF_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen && seen >= fraction * histogram->frames)
+            return i && (1ull << i) - 1 < histogram->max ? (1ull << i) - 1 : histogram->max;
+    }
+    return histogram->max;
+}
+
+bool prof_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        return false;
+    }
+
+    const uint64_t ticks = __rdtsc() - start_tsc;
+    const double tick_us = ticks ? (SDL_GetTicksNS() - start_ns) / 1e3 / ticks : 0.0;
+    const size_t len = strlen(path);
+    const bool json = len >= 5 && !strcmp(path + len - 5, ".json");
+
+    if (json)
+        fprintf(f, "{\n  \"tick_ns\": %.6f,\n  \"zones\": {\n", tick_us * 1e3);
+    else
+        fprintf(f, "zone,frames,mean_us,min_us,p50_us,p99_us,max_us,total_ms\n");
+
+    for (uint8_t i = 0; i <= PROF_ZONES; i++) {
+        const struct prof_histogram_s *h = &histograms[i];
+        const double mean_us = h->frames ? h->total * tick_us / h->frames : 0.0;
+        const double min_us = h->frames ? h->min * tick_us : 0.0;
+        const double p50_us = prof_percentile(h, 0.50) * tick_us;
+        const double p99_us = prof_percentile(h, 0.99) * tick_us;
+
+        if (!json) {
+            fprintf(f, "%s,%"PRIu64",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", names[i], h->frames, mean_us, min_us, p50_us, p99_us, h->max * tick_us, h->total * tick_us / 1e3);
+            continue;
+        }
+
+        fprintf(f, "    \"%s\": {\"frames\": %"PRIu64", \"mean_us\": %.3f, \"min_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"total_ms\": %.3f, \"histogram\": [",
+            names[i], h->frames, mean_us, min_us, p50_us, p99_us, h->max * tick_us, h->total * tick_us / 1e3);
+        bool first = true;
+        for (uint8_t b = 0; b < PROF_BUCKETS; b++) {
+            if (!h->buckets[b])
+                continue;
+            fprintf(f, "%s{\"below_us\": %.3f, \"frames\": %"PRIu64"}", first ? "" : ", ", (1ull << b) * tick_us, h->buckets[b]);
+            first = false;
+        }
+        fprintf(f, "]}%s\n", i < PROF_ZONES ? "," : "");
+    }
+
+    if (json)
+        fprintf(f, "  }\n}\n");
+
+    const bool written = !ferror(f);
+    if (fclose(f) || !written) {
+        LOG_MESG(LOG_WARN, "Couldn't write the profile to %s", path);
+        return false;
+    }
+
+    LOG_MESG(LOG_INFO, "Profile of %"PRIu64" frames written to %s", histograms[PROF_ZONES].frames, path);
+    return true;
+}
+
+#endif
\ No newline at end of file
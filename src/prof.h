@@ -0,0 +1,73 @@
+#ifndef PROF
+#define PROF
+
+#include <inttypes.h>
+
+/* host time per frame spent in each part of the emulator, measured with the time stamp counter.
+ * Only built with VGE_PROFILE defined (make PROFILE=yes), everything below compiles out otherwise.
+ * Zones nest: time goes to the innermost one, so memory accesses made by the cpu count as memory */
+
+enum prof_zone_e: uint8_t {
+    PROF_CPU,
+    PROF_MEMORY,
+    PROF_PPU,
+    PROF_TIMER, // timer and interrupts
+    PROF_INPUT,
+    PROF_PRESENT,
+    PROF_SLEEP,
+    PROF_ZONES
+};
+
+#ifdef VGE_PROFILE
+
+#include <x86intrin.h>
+
+#define PROF_DEPTH 8
+
+struct prof_s {
+    uint64_t mark; // when the time of the innermost zone was last counted
+    uint8_t depth;
+    enum prof_zone_e stack[PROF_DEPTH];
+    uint64_t frame[PROF_ZONES]; // ticks of the running frame
+};
+
+extern struct prof_s prof;
+
+static inline enum prof_zone_e prof_begin(enum prof_zone_e zone) {
+    const uint64_t now = __rdtsc();
+    if (prof.depth)
+        prof.frame[prof.stack[prof.depth - 1]] += now - prof.mark;
+    prof.stack[prof.depth++] = zone;
+    prof.mark = now;
+    return zone;
+}
+
+static inline void prof_end(const enum prof_zone_e *zone) {
+    (void)zone;
+    const uint64_t now = __rdtsc();
+    prof.frame[prof.stack[--prof.depth]] += now - prof.mark;
+    prof.mark = now;
+}
+
+void prof_init();
+/* closes the running frame into the histograms */
+void prof_frame();
+/* csv, or json when `path` ends with .json */
+bool prof_dump(const char *path);
+
+/* the rest of the enclosing block, whatever way it is left */
+#define PROF_SCOPE(zone) __attribute__((cleanup(prof_end))) const enum prof_zone_e prof_scope = prof_begin(zone)
+#define PROF_INIT() prof_init()
+#define PROF_FRAME() prof_frame()
+#define PROF_DUMP(path) prof_dump(path)
+
+#else
+
+#define PROF_SCOPE(zone)
+#define PROF_INIT()
+#define PROF_FRAME()
+#define PROF_DUMP(path) ((void)(path))
+
+#endif
+
+#endif
\ No newline at end of file
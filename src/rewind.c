@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "rewind.h"
+#include "state.h"
+
+#define REWIND_MAX_ENTRIES (60 * 60 * 10) // 10 minutes at 60 frames per second
+
+/* Each entry is the XOR between two consecutive states, run length encoded:
+ * a sequence of [zero run][literal run][literal bytes], both runs being LEB128 varints.
+ * The ring only keeps the newest full state, older ones are rebuilt by applying the deltas backward. */
+
+struct rewind_entry_s {
+    size_t offset;
+    size_t size;
+};
+
+struct rewind_s {
+    uint8_t *buffer;
+    size_t capacity;
+
+    struct rewind_entry_s entries[REWIND_MAX_ENTRIES];
+    size_t first;
+    size_t count;
+
+    size_t state_size;
+    bool has_current;
+    uint8_t *current;
+    uint8_t *state;
+    uint8_t *scratch;
+};
+
+static struct rewind_s *ring = NULL;
+
+bool rewind_init(size_t capacity) {
+    ring = calloc(1, sizeof(struct rewind_s));
+    if (!ring) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    ring->capacity = capacity;
+    ring->state_size = state_size();
+    ring->buffer = malloc(capacity);
+    ring->current = malloc(ring->state_size);
+    ring->state = malloc(ring->state_size);
+    ring->scratch = malloc(ring->state_size * 2 + 16); // worst case of the encoding
+    if (!ring->buffer || !ring->current || !ring->state || !ring->scratch) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        rewind_shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void rewind_shutdown() {
+    if (!ring)
+        return;
+
+    free(ring->buffer);
+    free(ring->current);
+    free(ring->state);
+    free(ring->scratch);
+    free(ring);
+    ring = NULL;
+}
+
+static uint8_t *varint_write(uint8_t *dst, size_t value) {
+    while (value >= 0x80) {
+        *dst++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *dst++ = (uint8_t)value;
+    return dst;
+}
+
+static const uint8_t *varint_read(const uint8_t *src, size_t *value) {
+    size_t result = 0;
+    uint8_t shift = 0;
+    while (*src & 0x80) {
+        result |= ((size_t)(*src++ & 0x7F)) << shift;
+        shift += 7;
+    }
+    *value = result | (((size_t)*src++) << shift);
+    return src;
+}
+
+static size_t zero_run(const uint8_t *delta, size_t pos, size_t size) {
+    const size_t start = pos;
+    uint64_t word;
+
+    while (pos + sizeof(word) <= size) {
+        memcpy(&word, delta + pos, sizeof(word));
+        if (word)
+            break;
+        pos += sizeof(word);
+    }
+
+    while (pos < size && !delta[pos])
+        pos++;
+
+    return pos - start;
+}
+
+/* XOR `state` into `current` (turning it into the delta) and encode it into scratch */
+static size_t delta_encode(uint8_t *current, const uint8_t *state, size_t size, uint8_t *dst) {
+    uint8_t *const begin = dst;
+
+    for (size_t i = 0; i < size; i++)
+        current[i] ^= state[i];
+
+    size_t pos = 0;
+    while (pos < size) {
+        const size_t zeros = zero_run(current, pos, size);
+        pos += zeros;
+
+        const size_t literal_begin = pos;
+        while (pos < size) {
+            // end the literal run on at least 4 zeros, shorter runs cost more than they save
+            if (!current[pos] && pos + 4 <= size && !current[pos + 1] && !current[pos + 2] && !current[pos + 3])
+                break;
+            pos++;
+        }
+
+        dst = varint_write(dst, zeros);
+        dst = varint_write(dst, pos - literal_begin);
+        memcpy(dst, current + literal_begin, pos - literal_begin);
+        dst += pos - literal_begin;
+    }
+
+    return dst - begin;
+}
+
+/* XOR the encoded delta into `state` */
+static void delta_apply(uint8_t *state, const uint8_t *src, size_t src_size) {
+    const uint8_t *const end = src + src_size;
+    size_t pos = 0;
+
+    while (src < end) {
+        size_t zeros, literals;
+        src = varint_read(src, &zeros);
+        src = varint_read(src, &literals);
+        pos += zeros;
+        for (size_t i = 0; i < literals; i++)
+            state[pos + i] ^= src[i];
+        src += literals;
+        pos += literals;
+    }
+}
+
+static bool overlap(const struct rewind_entry_s *entry, size_t offset, size_t size) {
+    return entry->offset < offset + size && offset < entry->offset + entry->size;
+}
+
+static void drop_oldest() {
+    ring->first = (ring->first + 1) % REWIND_MAX_ENTRIES;
+    ring->count--;
+}
+
+void rewind_push() {
+    if (!ring)
+        return;
+
+    state_save(ring->state);
+
+    if (!ring->has_current) {
+        memcpy(ring->current, ring->state, ring->state_size);
+        ring->has_current = true;
+        return;
+    }
+
+    const size_t size = delta_encode(ring->current, ring->state, ring->state_size, ring->scratch);
+    memcpy(ring->current, ring->state, ring->state_size);
+
+    if (size > ring->capacity) {
+        LOG_MESG(LOG_WARN, "Rewind buffer too small for a single frame (%zu bytes)", size);
+        ring->count = 0;
+        return;
+    }
+
+    size_t offset = 0;
+    if (ring->count) {
+        const struct rewind_entry_s *last = &ring->entries[(ring->first + ring->count - 1) % REWIND_MAX_ENTRIES];
+        const size_t end = last->offset + last->size;
+        offset = end;
+        if (offset + size > ring->capacity) {
+            offset = 0;
+            // the entries past the newest one are left from the previous pass, so the oldest: they go first
+            while (ring->count && ring->entries[ring->first].offset >= end)
+                drop_oldest();
+        }
+    }
+
+    // drop the oldest frames until there is room
+    while (ring->count && (ring->count == REWIND_MAX_ENTRIES || overlap(&ring->entries[ring->first], offset, size)))
+        drop_oldest();
+
+    memcpy(ring->buffer + offset, ring->scratch, size);
+
+    struct rewind_entry_s *entry = &ring->entries[(ring->first + ring->count) % REWIND_MAX_ENTRIES];
+    entry->offset = offset;
+    entry->size = size;
+    ring->count++;
+}
+
+bool rewind_pop() {
+    if (!ring || !ring->count)
+        return false;
+
+    const struct rewind_entry_s *entry = &ring->entries[(ring->first + ring->count - 1) % REWIND_MAX_ENTRIES];
+    delta_apply(ring->current, ring->buffer + entry->offset, entry->size);
+    ring->count--;
+
+    // the core is left as it was, but the deltas don't lead anywhere it can go anymore
+    if (!state_load(ring->current)) {
+        LOG_MESG(LOG_WARN, "Couldn't restore a rewind state, the rewind buffer is dropped");
+        ring->count = 0;
+        ring->has_current = false;
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef REWIND
+#define REWIND
+
+#include <inttypes.h>
+#include <stddef.h>
+
+bool rewind_init(size_t capacity);
+void rewind_shutdown();
+
+void rewind_push();
+bool rewind_pop();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "scale.h"
+
+#define SCALE_MAX_THREADS 7
+#define SCALE_MAX_OUT_WIDTH (SCALE_MAX_WIDTH * SCALE_MAX_FACTOR)
+
+/* rows a participant works on, each participant scaling its own band of source rows */
+struct scale_scratch_s {
+    uint32_t padded[3][SCALE_MAX_WIDTH + 2]; // the rows above, at and below, their edge pixels repeated on both sides
+    uint32_t rows[3][SCALE_MAX_WIDTH * 3]; // out of Scale2x / Scale3x
+};
+
+struct scale_job_s {
+    enum scale_filter_e filter;
+    const uint32_t *src;
+    uint16_t width;
+    uint16_t height;
+    uint8_t factor;
+    uint32_t *dst;
+    size_t dst_pitch;
+
+    /* the final nearest stretch of each row, `stretch` times wider than `in_width` */
+    uint16_t in_width;
+    uint8_t stretch;
+    uint32_t first[SCALE_MAX_OUT_WIDTH / 8]; // source pixel of the first of each 8 output pixels
+    uint32_t index[SCALE_MAX_OUT_WIDTH / 8][8]; // source pixel of each of them, from `first`
+    uint32_t grid[SCALE_MAX_OUT_WIDTH]; // LCD: all bits set on the last column of each source pixel
+};
+
+struct scaler_s {
+    SDL_Thread *threads[SCALE_MAX_THREADS];
+    uint8_t thread_count;
+    SDL_Mutex *mutex;
+    SDL_Condition *wake;
+    SDL_Condition *done;
+    uint64_t job_id;
+    uint8_t remaining; // threads still working on the job
+    bool quit;
+
+    struct scale_job_s job;
+    struct scale_scratch_s scratch[SCALE_MAX_THREADS + 1]; // the last one for the calling thread
+};
+
+static struct scaler_s scaler = { 0 };
+
+static const struct {
+    const char *name;
+    enum scale_filter_e filter;
+} filter_names[] = {
+    { "nearest", SCALE_NEAREST },
+    { "scale2x", SCALE_2X },
+    { "scale3x", SCALE_3X },
+    { "lcd", SCALE_LCD },
+};
+
+/* 75% of the color */
+static uint32_t darken(uint32_t pixel) {
+    return (((pixel >> 1) & 0x7F7F7F) + ((pixel >> 2) & 0x3F3F3F)) | 0xFF000000;
+}
+
+#ifdef __AVX2__
+static __m256i darken_8(__m256i pixels) {
+    const __m256i half = _mm256_and_si256(_mm256_srli_epi32(pixels, 1), _mm256_set1_epi32(0x7F7F7F));
+    const __m256i quarter = _mm256_and_si256(_mm256_srli_epi32(pixels, 2), _mm256_set1_epi32(0x3F3F3F));
+    return _mm256_or_si256(_mm256_add_epi32(half, quarter), _mm256_set1_epi32((int32_t)0xFF000000));
+}
+#endif
+
+static void stretch_prepare(struct scale_job_s *job, uint16_t in_width, uint8_t stretch) {
+    job->in_width = in_width;
+    job->stretch = stretch;
+    for (uint16_t i = 0; i < in_width * stretch / 8; i++) {
+        job->first[i] = i * 8 / stretch;
+        for (uint8_t j = 0; j < 8; j++)
+            job->index[i][j] = (i * 8 + j) / stretch - job->first[i];
+    }
+}
+
+static void stretch_row(const struct scale_job_s *job, const uint32_t *src, uint32_t *dst) {
+    const uint16_t out_width = job->in_width * job->stretch;
+    uint16_t x = 0;
+#ifdef __AVX2__
+    // each 8 output pixels come from at most 8 consecutive source ones, shuffled across the register
+    for (; x + 8 <= out_width && job->first[x / 8] + 8 <= job->in_width; x += 8) {
+        const __m256i pixels = _mm256_loadu_si256((const __m256i *)(src + job->first[x / 8]));
+        const __m256i index = _mm256_loadu_si256((const __m256i *)job->index[x / 8]);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_permutevar8x32_epi32(pixels, index));
+    }
+#endif
+    for (; x < out_width; x++)
+        dst[x] = src[x / job->stretch];
+}
+
+/* LCD: darken the last column of each pixel in `row`, and the whole of `last` (the last row of each pixel) */
+static void lcd_grid(const struct scale_job_s *job, uint32_t *row, uint32_t *last) {
+    const uint16_t out_width = job->in_width * job->stretch;
+    uint16_t x = 0;
+#ifdef __AVX2__
+    for (; x + 8 <= out_width; x += 8) {
+        const __m256i pixels = _mm256_loadu_si256((const __m256i *)(row + x));
+        const __m256i grid = _mm256_loadu_si256((const __m256i *)(job->grid + x));
+        _mm256_storeu_si256((__m256i *)(last + x), darken_8(pixels));
+        _mm256_storeu_si256((__m256i *)(row + x), _mm256_blendv_epi8(pixels, darken_8(pixels), grid));
+    }
+#endif
+    for (; x < out_width; x++) {
+        last[x] = darken(row[x]);
+        if (job->grid[x])
+            row[x] = darken(row[x]);
+    }
+}
+
+static void pad_row(const uint32_t *src, uint16_t width, uint32_t *padded) {
+    padded[0] = src[0];
+    memcpy(padded + 1, src, width * sizeof(uint32_t));
+    padded[width + 1] = src[width - 1];
+}
+
+/*
+ * Scale2x, for each pixel E and its neighbours:  B
+ *                                               D E F
+ *                                                 H
+ */
+static void scale2x_row(const struct scale_scratch_s *scratch, uint16_t width, uint32_t *out0, uint32_t *out1) {
+    const uint32_t *up = scratch->padded[0], *mid = scratch->padded[1], *down = scratch->padded[2];
+    uint16_t x = 0;
+#ifdef __AVX2__
+    for (; x + 8 <= width; x += 8) {
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(up + x + 1));
+        const __m256i d = _mm256_loadu_si256((const __m256i *)(mid + x));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(mid + x + 1));
+        const __m256i f = _mm256_loadu_si256((const __m256i *)(mid + x + 2));
+        const __m256i h = _mm256_loadu_si256((const __m256i *)(down + x + 1));
+
+        const __m256i db = _mm256_cmpeq_epi32(d, b), bf = _mm256_cmpeq_epi32(b, f);
+        const __m256i dh = _mm256_cmpeq_epi32(d, h), hf = _mm256_cmpeq_epi32(h, f);
+
+        // the condition ANDed with the negation of the two others
+        const __m256i e0 = _mm256_blendv_epi8(e, b, _mm256_andnot_si256(_mm256_or_si256(dh, bf), db));
+        const __m256i e1 = _mm256_blendv_epi8(e, f, _mm256_andnot_si256(_mm256_or_si256(db, hf), bf));
+        const __m256i e2 = _mm256_blendv_epi8(e, d, _mm256_andnot_si256(_mm256_or_si256(db, hf), dh));
+        const __m256i e3 = _mm256_blendv_epi8(e, h, _mm256_andnot_si256(_mm256_or_si256(dh, bf), hf));
+
+        // interleave, the unpacks work within each 128 bits half
+        const __m256i top_lo = _mm256_unpacklo_epi32(e0, e1), top_hi = _mm256_unpackhi_epi32(e0, e1);
+        const __m256i bottom_lo = _mm256_unpacklo_epi32(e2, e3), bottom_hi = _mm256_unpackhi_epi32(e2, e3);
+        _mm256_storeu_si256((__m256i *)(out0 + x * 2), _mm256_permute2x128_si256(top_lo, top_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out0 + x * 2 + 8), _mm256_permute2x128_si256(top_lo, top_hi, 0x31));
+        _mm256_storeu_si256((__m256i *)(out1 + x * 2), _mm256_permute2x128_si256(bottom_lo, bottom_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out1 + x * 2 + 8), _mm256_permute2x128_si256(bottom_lo, bottom_hi, 0x31));
+    }
+#endif
+    for (; x < width; x++) {
+        const uint32_t b = up[x + 1], d = mid[x], e = mid[x + 1], f = mid[x + 2], h = down[x + 1];
+        out0[x * 2] = d == b && d != h && b != f ? b : e;
+        out0[x * 2 + 1] = b == f && b != d && f != h ? f : e;
+        out1[x * 2] = d == h && d != b && h != f ? d : e;
+        out1[x * 2 + 1] = h == f && h != d && f != b ? h : e;
+    }
+}
+
+/*
+ * Scale3x (AdvMAME3x), for each pixel E and its neighbours: A B C
+ *                                                           D E F
+ *                                                           G H I
+ */
+static void scale3x_row(const struct scale_scratch_s *scratch, uint16_t width, uint32_t *out0, uint32_t *out1, uint32_t *out2) {
+    const uint32_t *up = scratch->padded[0], *mid = scratch->padded[1], *down = scratch->padded[2];
+    uint16_t x = 0;
+#ifdef __AVX2__
+    for (; x + 8 <= width; x += 8) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(up + x));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(up + x + 1));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(up + x + 2));
+        const __m256i d = _mm256_loadu_si256((const __m256i *)(mid + x));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(mid + x + 1));
+        const __m256i f = _mm256_loadu_si256((const __m256i *)(mid + x + 2));
+        const __m256i g = _mm256_loadu_si256((const __m256i *)(down + x));
+        const __m256i h = _mm256_loadu_si256((const __m256i *)(down + x + 1));
+        const __m256i i = _mm256_loadu_si256((const __m256i *)(down + x + 2));
+
+        const __m256i db = _mm256_cmpeq_epi32(d, b), bf = _mm256_cmpeq_epi32(b, f);
+        const __m256i dh = _mm256_cmpeq_epi32(d, h), hf = _mm256_cmpeq_epi32(h, f);
+        const __m256i ea = _mm256_cmpeq_epi32(e, a), ec = _mm256_cmpeq_epi32(e, c);
+        const __m256i eg = _mm256_cmpeq_epi32(e, g), ei = _mm256_cmpeq_epi32(e, i);
+
+        // the four corners the pixel can take from its neighbours
+        const __m256i up_left = _mm256_andnot_si256(_mm256_or_si256(dh, bf), db);
+        const __m256i up_right = _mm256_andnot_si256(_mm256_or_si256(db, hf), bf);
+        const __m256i down_left = _mm256_andnot_si256(_mm256_or_si256(db, hf), dh);
+        const __m256i down_right = _mm256_andnot_si256(_mm256_or_si256(dh, bf), hf);
+
+        uint32_t out[9][8];
+        _mm256_storeu_si256((__m256i *)out[0], _mm256_blendv_epi8(e, d, up_left));
+        _mm256_storeu_si256((__m256i *)out[1], _mm256_blendv_epi8(e, b, _mm256_or_si256(_mm256_andnot_si256(ec, up_left), _mm256_andnot_si256(ea, up_right))));
+        _mm256_storeu_si256((__m256i *)out[2], _mm256_blendv_epi8(e, f, up_right));
+        _mm256_storeu_si256((__m256i *)out[3], _mm256_blendv_epi8(e, d, _mm256_or_si256(_mm256_andnot_si256(eg, up_left), _mm256_andnot_si256(ea, down_left))));
+        _mm256_storeu_si256((__m256i *)out[4], e);
+        _mm256_storeu_si256((__m256i *)out[5], _mm256_blendv_epi8(e, f, _mm256_or_si256(_mm256_andnot_si256(ei, up_right), _mm256_andnot_si256(ec, down_right))));
+        _mm256_storeu_si256((__m256i *)out[6], _mm256_blendv_epi8(e, d, down_left));
+        _mm256_storeu_si256((__m256i *)out[7], _mm256_blendv_epi8(e, h, _mm256_or_si256(_mm256_andnot_si256(ei, down_left), _mm256_andnot_si256(eg, down_right))));
+        _mm256_storeu_si256((__m256i *)out[8], _mm256_blendv_epi8(e, f, down_right));
+
+        for (uint8_t j = 0; j < 8; j++) {
+            for (uint8_t k = 0; k < 3; k++) {
+                out0[(x + j) * 3 + k] = out[k][j];
+                out1[(x + j) * 3 + k] = out[3 + k][j];
+                out2[(x + j) * 3 + k] = out[6 + k][j];
+            }
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        const uint32_t a = up[x], b = up[x + 1], c = up[x + 2];
+        const uint32_t d = mid[x], e = mid[x + 1], f = mid[x + 2];
+        const uint32_t g = down[x], h = down[x + 1], i = down[x + 2];
+
+        const bool up_left = d == b && d != h && b != f;
+        const bool up_right = b == f && b != d && f != h;
+        const bool down_left = d == h && d != b && h != f;
+        const bool down_right = h == f && h != d && f != b;
+
+        uint32_t *out[3] = { out0 + x * 3, out1 + x * 3, out2 + x * 3 };
+        out[0][0] = up_left ? d : e;
+        out[0][1] = (up_left && e != c) || (up_right && e != a) ? b : e;
+        out[0][2] = up_right ? f : e;
+        out[1][0] = (up_left && e != g) || (down_left && e != a) ? d : e;
+        out[1][1] = e;
+        out[1][2] = (up_right && e != i) || (down_right && e != c) ? f : e;
+        out[2][0] = down_left ? d : e;
+        out[2][1] = (down_left && e != i) || (down_right && e != g) ? h : e;
+        out[2][2] = down_right ? f : e;
+    }
+}
+
+static void scale_band(const struct scale_job_s *job, struct scale_scratch_s *scratch, uint16_t begin, uint16_t end) {
+    const size_t out_width = (size_t)job->width * job->factor;
+
+    for (uint16_t y = begin; y < end; y++) {
+        const uint32_t *src = job->src + (size_t)y * job->width;
+        uint32_t *dst = job->dst + (size_t)y * job->factor * job->dst_pitch;
+
+        if (job->filter == SCALE_NEAREST || job->filter == SCALE_LCD) {
+            stretch_row(job, src, dst);
+            uint8_t copies = job->factor - 1;
+            if (job->filter == SCALE_LCD) {
+                lcd_grid(job, dst, dst + copies * job->dst_pitch);
+                copies--;
+            }
+            for (uint8_t i = 1; i <= copies; i++)
+                memcpy(dst + i * job->dst_pitch, dst, out_width * sizeof(uint32_t));
+            continue;
+        }
+
+        pad_row(y ? src - job->width : src, job->width, scratch->padded[0]);
+        pad_row(src, job->width, scratch->padded[1]);
+        pad_row(y + 1 < job->height ? src + job->width : src, job->width, scratch->padded[2]);
+
+        const uint8_t base = job->filter == SCALE_2X ? 2 : 3;
+        if (base == 2)
+            scale2x_row(scratch, job->width, scratch->rows[0], scratch->rows[1]);
+        else
+            scale3x_row(scratch, job->width, scratch->rows[0], scratch->rows[1], scratch->rows[2]);
+
+        for (uint8_t i = 0; i < base; i++) {
+            uint32_t *row = dst + i * job->stretch * job->dst_pitch;
+            stretch_row(job, scratch->rows[i], row);
+            for (uint8_t j = 1; j < job->stretch; j++)
+                memcpy(row + j * job->dst_pitch, row, out_width * sizeof(uint32_t));
+        }
+    }
+}
+
+static void scale_participate(uint8_t participant) {
+    // the calling thread takes the last band
+    const uint8_t participants = scaler.thread_count + 1;
+    const uint16_t begin = scaler.job.height * participant / participants;
+    const uint16_t end = scaler.job.height * (participant + 1) / participants;
+    scale_band(&scaler.job, &scaler.scratch[participant], begin, end);
+}
+
+static int scale_thread(void *data) {
+    const uint8_t participant = (uint8_t)(uintptr_t)data;
+    uint64_t job_id = 0;
+
+    SDL_LockMutex(scaler.mutex);
+    while (true) {
+        while (scaler.job_id == job_id && !scaler.quit)
+            SDL_WaitCondition(scaler.wake, scaler.mutex);
+        if (scaler.quit)
+            break;
+
+        job_id = scaler.job_id;
+        SDL_UnlockMutex(scaler.mutex);
+        scale_participate(participant);
+        SDL_LockMutex(scaler.mutex);
+
+        if (!--scaler.remaining)
+            SDL_SignalCondition(scaler.done);
+    }
+    SDL_UnlockMutex(scaler.mutex);
+
+    return 0;
+}
+
+bool scale_init() {
+    // leave a core to the emulation and one to the render thread
+    const int cores = SDL_GetNumLogicalCPUCores() - 2;
+    const uint8_t threads = cores <= 0 ? 0 : (cores > SCALE_MAX_THREADS ? SCALE_MAX_THREADS : cores);
+    if (!threads)
+        return true;
+
+    scaler.mutex = SDL_CreateMutex();
+    scaler.wake = SDL_CreateCondition();
+    scaler.done = SDL_CreateCondition();
+    if (!scaler.mutex || !scaler.wake || !scaler.done) {
+        LOG_MESG(LOG_WARN, "Couldn't create the scaler synchronization: %s", SDL_GetError());
+        scale_shutdown();
+        return false;
+    }
+
+    for (; scaler.thread_count < threads; scaler.thread_count++) {
+        scaler.threads[scaler.thread_count] = SDL_CreateThread(scale_thread, "scaler", (void *)(uintptr_t)scaler.thread_count);
+        if (!scaler.threads[scaler.thread_count]) {
+            LOG_MESG(LOG_WARN, "Couldn't start a scaler thread: %s", SDL_GetError());
+            break;
+        }
+    }
+
+    return true;
+}
+
+void scale_shutdown() {
+    if (scaler.thread_count) {
+        SDL_LockMutex(scaler.mutex);
+        scaler.quit = true;
+        SDL_BroadcastCondition(scaler.wake);
+        SDL_UnlockMutex(scaler.mutex);
+        for (uint8_t i = 0; i < scaler.thread_count; i++)
+            SDL_WaitThread(scaler.threads[i], NULL);
+    }
+
+    if (scaler.done)
+        SDL_DestroyCondition(scaler.done);
+    if (scaler.wake)
+        SDL_DestroyCondition(scaler.wake);
+    if (scaler.mutex)
+        SDL_DestroyMutex(scaler.mutex);
+    memset(&scaler, 0, sizeof(scaler));
+}
+
+bool scale_filter_from_name(const char *name, enum scale_filter_e *filter) {
+    for (size_t i = 0; i < sizeof(filter_names) / sizeof(filter_names[0]); i++) {
+        if (!strcmp(filter_names[i].name, name)) {
+            *filter = filter_names[i].filter;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool scale_filter_supports(enum scale_filter_e filter, uint8_t factor) {
+    switch (filter) {
+        case SCALE_NEAREST:
+            return factor >= 1;
+        case SCALE_2X:
+            return !(factor % 2);
+        case SCALE_3X:
+            return !(factor % 3);
+        case SCALE_LCD:
+            return factor >= 2;
+    }
+    return false;
+}
+
+void scale_run(enum scale_filter_e filter, const uint32_t *src, uint16_t width, uint16_t height, uint8_t factor, uint32_t *dst, size_t dst_pitch) {
+    struct scale_job_s *job = &scaler.job;
+
+    job->filter = scale_filter_supports(filter, factor) ? filter : SCALE_NEAREST;
+    job->src = src;
+    job->width = width;
+    job->height = height;
+    job->factor = factor;
+    job->dst = dst;
+    job->dst_pitch = dst_pitch;
+
+    switch (job->filter) {
+        case SCALE_2X:
+            stretch_prepare(job, width * 2, factor / 2);
+            break;
+        case SCALE_3X:
+            stretch_prepare(job, width * 3, factor / 3);
+            break;
+        case SCALE_LCD:
+            for (size_t x = 0; x < (size_t)width * factor; x++)
+                job->grid[x] = x % factor == (size_t)factor - 1 ? UINT32_MAX : 0;
+            [[fallthrough]];
+        case SCALE_NEAREST:
+            stretch_prepare(job, width, factor);
+            break;
+    }
+
+    if (!scaler.thread_count) {
+        scale_band(job, &scaler.scratch[0], 0, height);
+        return;
+    }
+
+    SDL_LockMutex(scaler.mutex);
+    scaler.job_id++;
+    scaler.remaining = scaler.thread_count;
+    SDL_BroadcastCondition(scaler.wake);
+    SDL_UnlockMutex(scaler.mutex);
+
+    scale_participate(scaler.thread_count);
+
+    SDL_LockMutex(scaler.mutex);
+    while (scaler.remaining)
+        SDL_WaitCondition(scaler.done, scaler.mutex);
+    SDL_UnlockMutex(scaler.mutex);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef SCALE
+#define SCALE
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define SCALE_MAX_WIDTH 256 // of the source image
+#define SCALE_MAX_FACTOR 8
+
+enum scale_filter_e: uint8_t {
+    SCALE_NEAREST,
+    SCALE_2X, // Scale2x, then nearest for even factors
+    SCALE_3X, // Scale3x, then nearest for factors multiple of 3
+    SCALE_LCD, // nearest with the border of every pixel darkened
+};
+
+/* starts the worker threads, without them scaling runs on the calling thread only */
+bool scale_init();
+void scale_shutdown();
+
+bool scale_filter_from_name(const char *name, enum scale_filter_e *filter);
+/* false when the filter can't scale by `factor` */
+bool scale_filter_supports(enum scale_filter_e filter, uint8_t factor);
+
+/* scale an ARGB8888 `width` x `height` image by `factor`, `dst_pitch` being in pixels */
+void scale_run(enum scale_filter_e filter, const uint32_t *src, uint16_t width, uint16_t height, uint8_t factor, uint32_t *dst, size_t dst_pitch);
+
+#endif
\ No newline at end of file
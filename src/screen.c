@@ -7,18 +7,83 @@
 #include "log.h"
 
 #include "screen.h"
+#include "hash.h"
+#include "scale.h"
 
 #define FONT_SIZE 24
 
+#define GLYPH_FIRST ' '
+#define GLYPH_COUNT ('~' - GLYPH_FIRST + 1) // printable ascii, anything else shows as '?'
+#define GLYPH_COLUMNS 16
+#define PRINT_BATCH 64 // characters per draw call
+
 struct screen_s {
     uint16_t width;
     uint16_t height;
     uint16_t scale;
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    const uint32_t *framebuffer; // width * height pixels uploaded on present, if any
+    bool scaled; // the texture is at the window resolution, filled by the scaler
+    enum scale_filter_e filter;
+    uint64_t shown_hash; // of the framebuffer on screen
+    bool stale; // drawn to since the last present, or never presented
+    SDL_Texture *glyphs; // of the atlas, created by the first print
+    screen_overlay_f overlay; // drawn over the framebuffer on every present
+    bool vsync; // presents wait for the vertical sync
+};
+
+/* every glyph rendered once, white on black, in cells of a grid */
+struct glyph_atlas_s {
+    SDL_Surface *surface;
+    uint16_t cell_width;
+    uint16_t cell_height;
+    uint16_t widths[GLYPH_COUNT];
 };
 
 TTF_Font *font = NULL;
+static struct glyph_atlas_s atlas;
+
+static bool glyph_atlas_build() {
+    const SDL_Color white = {255, 255, 255, 255};
+    const SDL_Color black = {0, 0, 0, 255};
+
+    SDL_Surface *glyphs[GLYPH_COUNT];
+    atlas.cell_width = 0;
+    atlas.cell_height = TTF_GetFontHeight(font);
+    for (uint8_t i = 0; i < GLYPH_COUNT; i++) {
+        glyphs[i] = TTF_RenderGlyph_Shaded(font, GLYPH_FIRST + i, white, black);
+        if (!glyphs[i]) {
+            LOG_MESG(LOG_WARN, "Couldn't render glyph '%c'", GLYPH_FIRST + i);
+            while (i--)
+                SDL_DestroySurface(glyphs[i]);
+            return false;
+        }
+        atlas.widths[i] = glyphs[i]->w;
+        if (glyphs[i]->w > atlas.cell_width)
+            atlas.cell_width = glyphs[i]->w;
+    }
+
+    const uint8_t rows = (GLYPH_COUNT + GLYPH_COLUMNS - 1) / GLYPH_COLUMNS;
+    atlas.surface = SDL_CreateSurface(atlas.cell_width * GLYPH_COLUMNS, atlas.cell_height * rows, SDL_PIXELFORMAT_ARGB8888);
+    if (!atlas.surface)
+        LOG_MESG(LOG_WARN, "Couldn't create the glyph atlas: %s", SDL_GetError());
+
+    for (uint8_t i = 0; i < GLYPH_COUNT; i++) {
+        SDL_Rect cell = {
+            .x = (i % GLYPH_COLUMNS) * atlas.cell_width,
+            .y = (i / GLYPH_COLUMNS) * atlas.cell_height,
+            .w = glyphs[i]->w,
+            .h = glyphs[i]->h
+        };
+        if (atlas.surface)
+            SDL_BlitSurface(glyphs[i], NULL, atlas.surface, &cell);
+        SDL_DestroySurface(glyphs[i]);
+    }
+
+    return atlas.surface;
+}
 
 bool screen_global_init() {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
@@ -48,10 +113,22 @@ bool screen_global_init() {
         return false;
     }
 
+    if (!glyph_atlas_build()) {
+        TTF_CloseFont(font);
+        TTF_Quit();
+        SDL_Quit();
+        return false;
+    }
+
+    scale_init();
+
     return true;
 }
 
 void screen_global_shutdown() {
+    scale_shutdown();
+    if (atlas.surface)
+        SDL_DestroySurface(atlas.surface);
     TTF_CloseFont(font);
     TTF_Quit();
     SDL_Quit();
@@ -65,6 +142,14 @@ struct screen_s *screen_create(char *title, uint16_t width, uint16_t height, uin
     screen->scale = scale;
     screen->width = width;
     screen->height = height;
+    screen->texture = NULL;
+    screen->glyphs = NULL;
+    screen->overlay = NULL;
+    screen->framebuffer = NULL;
+    screen->scaled = width <= SCALE_MAX_WIDTH && scale <= SCALE_MAX_FACTOR;
+    screen->filter = SCALE_NEAREST;
+    screen->stale = true;
+    screen->vsync = false;
 
     if (!SDL_CreateWindowAndRenderer(title, width * scale, height * scale, 0, &screen->window, &screen->renderer)) {
         LOG_MESG(LOG_WARN, "Couldn't create window and renderer: %s", SDL_GetError());
@@ -73,11 +158,59 @@ struct screen_s *screen_create(char *title, uint16_t width, uint16_t height, uin
     }
 
     return screen;
+}
 
-    return NULL;
+void screen_set_framebuffer(struct screen_s *screen, const uint32_t *framebuffer) {
+    if (framebuffer && !screen->texture) {
+        // scaled by the cpu when possible, by the gpu otherwise
+        const uint16_t scale = screen->scaled ? screen->scale : 1;
+        screen->texture = SDL_CreateTexture(screen->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, screen->width * scale, screen->height * scale);
+        if (!screen->texture) {
+            LOG_MESG(LOG_WARN, "Couldn't create texture: %s", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureScaleMode(screen->texture, SDL_SCALEMODE_NEAREST);
+    }
+
+    screen->framebuffer = framebuffer;
+}
+
+void screen_set_overlay(struct screen_s *screen, screen_overlay_f overlay) {
+    screen->overlay = overlay;
+    screen->stale = true;
+}
+
+bool screen_set_filter(struct screen_s *screen, enum scale_filter_e filter) {
+    if (!screen->scaled || !scale_filter_supports(filter, screen->scale))
+        return false;
+
+    screen->filter = filter;
+    screen->stale = true;
+    return true;
+}
+
+float screen_refresh_rate(struct screen_s *screen) {
+    const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(screen->window));
+    return mode ? mode->refresh_rate : 0;
+}
+
+void screen_set_vsync(struct screen_s *screen, bool vsync) {
+    if (screen->vsync == vsync)
+        return;
+
+    if (!SDL_SetRenderVSync(screen->renderer, vsync ? 1 : 0)) {
+        LOG_MESG(LOG_WARN, "Couldn't set vsync: %s", SDL_GetError());
+        return;
+    }
+    screen->vsync = vsync;
+}
+
+void screen_invalidate(struct screen_s *screen) {
+    screen->stale = true;
 }
 
 void screen_clear(struct screen_s *screen) {
+    screen->stale = true;
     SDL_SetRenderDrawColor(screen->renderer, 0, 0, 0, 0);
     SDL_RenderClear(screen->renderer);
 }
@@ -90,36 +223,73 @@ uint16_t screen_get_height(struct screen_s *screen) {
     return screen->height;
 }
 
+/* each character is a quad textured from the atlas, stretched to a FONT_WIDTH_SIZE x FONT_HEIGHT_SIZE
+ * cell, and the quads of a message are drawn together */
 void screen_print(struct screen_s *screen, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b, char *msg) {
-    SDL_Color color = {r, g, b, 255};
-    SDL_Color bgcolor = {0, 0, 0, 255};
-
-    size_t msg_len = strlen(msg);
-    SDL_Surface *text_surface = TTF_RenderText_Shaded(font, msg, msg_len, color, bgcolor);
-    if(!text_surface)
-        LOG_MESG(LOG_WARN, "Couldn't create surface from text");
-    else {
-        SDL_Texture *text_texture = SDL_CreateTextureFromSurface(screen->renderer, text_surface);
-        SDL_DestroySurface(text_surface);
-        if (!text_texture) {
-            LOG_MESG(LOG_WARN, "Couldn't create texture from surface: %s", SDL_GetError());
+    screen->stale = true;
+
+    if (!screen->glyphs) {
+        screen->glyphs = SDL_CreateTextureFromSurface(screen->renderer, atlas.surface);
+        if (!screen->glyphs) {
+            LOG_MESG(LOG_WARN, "Couldn't create texture from the glyph atlas: %s", SDL_GetError());
             return;
         }
+    }
+
+    // the white glyphs are tinted by the vertex color, their black background stays black
+    const SDL_FColor color = {r / 255.0f, g / 255.0f, b / 255.0f, 1.0f};
+    const float atlas_width = atlas.surface->w, atlas_height = atlas.surface->h;
+    const float cell_width = screen->scale * FONT_WIDTH_SIZE, cell_height = screen->scale * FONT_HEIGHT_SIZE;
 
-        SDL_FRect dst_rect;
-        dst_rect.x = x * screen->scale;
-        dst_rect.y = y * screen->scale;
-        dst_rect.h = screen->scale * FONT_HEIGHT_SIZE;
-        dst_rect.w = msg_len * screen->scale * FONT_WIDTH_SIZE;
+    SDL_Vertex vertices[PRINT_BATCH * 4];
+    int indices[PRINT_BATCH * 6];
+    float left = x * screen->scale;
+    const float top = y * screen->scale;
+    while (*msg) {
+        int quads = 0;
+        for (; *msg && quads < PRINT_BATCH; msg++, quads++, left += cell_width) {
+            const uint8_t c = *msg;
+            const uint8_t glyph = c >= GLYPH_FIRST && c < GLYPH_FIRST + GLYPH_COUNT ? c - GLYPH_FIRST : '?' - GLYPH_FIRST;
+            const float u0 = (glyph % GLYPH_COLUMNS) * atlas.cell_width / atlas_width;
+            const float v0 = (glyph / GLYPH_COLUMNS) * atlas.cell_height / atlas_height;
+            const float u1 = u0 + atlas.widths[glyph] / atlas_width;
+            const float v1 = v0 + atlas.cell_height / atlas_height;
 
-        if (!SDL_RenderTexture(screen->renderer, text_texture, NULL, &dst_rect))
-            LOG_MESG(LOG_WARN, "Couldn't blit surface: %s", SDL_GetError());
+            SDL_Vertex *v = &vertices[quads * 4];
+            v[0] = (SDL_Vertex){ .position = {left, top}, .color = color, .tex_coord = {u0, v0} };
+            v[1] = (SDL_Vertex){ .position = {left + cell_width, top}, .color = color, .tex_coord = {u1, v0} };
+            v[2] = (SDL_Vertex){ .position = {left + cell_width, top + cell_height}, .color = color, .tex_coord = {u1, v1} };
+            v[3] = (SDL_Vertex){ .position = {left, top + cell_height}, .color = color, .tex_coord = {u0, v1} };
+
+            int *index = &indices[quads * 6];
+            index[0] = quads * 4;
+            index[1] = quads * 4 + 1;
+            index[2] = quads * 4 + 2;
+            index[3] = quads * 4;
+            index[4] = quads * 4 + 2;
+            index[5] = quads * 4 + 3;
+        }
 
-        SDL_DestroyTexture(text_texture);
+        if (!SDL_RenderGeometry(screen->renderer, screen->glyphs, vertices, quads * 4, indices, quads * 6))
+            LOG_MESG(LOG_WARN, "Couldn't draw text: %s", SDL_GetError());
     }
 }
 
+void screen_draw_rect(struct screen_s *screen, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t r, uint8_t g, uint8_t b) {
+    screen->stale = true;
+    SDL_SetRenderDrawColor(screen->renderer, r, g, b, 255);
+    SDL_FRect rect = {
+        .x = x * screen->scale,
+        .y = y * screen->scale,
+        .w = w * screen->scale,
+        .h = h * screen->scale
+    };
+
+    SDL_RenderFillRect(screen->renderer, &rect);
+}
+
 void screen_draw_pixel(struct screen_s *screen, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b) {
+    screen->stale = true;
     SDL_SetRenderDrawColor(screen->renderer, r, g, b, 255);
     SDL_FRect rect = {
         .x = x * screen->scale,
@@ -135,12 +305,56 @@ void screen_draw_pixel(struct screen_s *screen, uint32_t x, uint32_t y, uint8_t
             SDL_RenderPoint(screen->renderer, x * screen->scale + i, y * screen->scale + j);*/
 }
 
-void screen_present(struct screen_s *screen) {
+static bool screen_upload(struct screen_s *screen) {
+    if (!screen->scaled)
+        return SDL_UpdateTexture(screen->texture, NULL, screen->framebuffer, screen->width * sizeof(uint32_t));
+
+    void *pixels;
+    int pitch;
+    if (!SDL_LockTexture(screen->texture, NULL, &pixels, &pitch))
+        return false;
+    scale_run(screen->filter, screen->framebuffer, screen->width, screen->height, screen->scale, pixels, pitch / sizeof(uint32_t));
+    SDL_UnlockTexture(screen->texture);
+
+    return true;
+}
+
+bool screen_present(struct screen_s *screen) {
+    // nobody would see it, present again once the window shows up
+    if (SDL_GetWindowFlags(screen->window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED | SDL_WINDOW_OCCLUDED)) {
+        screen->stale = true;
+        return false;
+    }
+
+    if (screen->framebuffer) {
+        // an identical frame with nothing drawn over it is already on screen
+        const uint64_t hash = hash_pixels(screen->framebuffer, screen->width * screen->height);
+        if (!screen->stale && !screen->overlay && hash == screen->shown_hash)
+            return false;
+        screen->shown_hash = hash;
+
+        if (!screen_upload(screen))
+            LOG_MESG(LOG_WARN, "Couldn't update texture: %s", SDL_GetError());
+        else if (!SDL_RenderTexture(screen->renderer, screen->texture, NULL, NULL))
+            LOG_MESG(LOG_WARN, "Couldn't render texture: %s", SDL_GetError());
+    }
+
+    if (screen->overlay)
+        screen->overlay(screen);
+
     SDL_RenderPresent(screen->renderer);
-    
+    screen->stale = false;
+    return screen->vsync;
 }
 
 void screen_destroy(struct screen_s *screen) {
+    if (!screen)
+        return;
+
+    if (screen->texture)
+        SDL_DestroyTexture(screen->texture);
+    if (screen->glyphs)
+        SDL_DestroyTexture(screen->glyphs);
     SDL_DestroyRenderer(screen->renderer);
     SDL_DestroyWindow(screen->window);
     free(screen);
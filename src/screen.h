@@ -3,11 +3,18 @@
 
 #include <inttypes.h>
 
+#include "scale.h"
+
 #define FONT_WIDTH_SIZE 4
 #define FONT_HEIGHT_SIZE 8
 
+/* framebuffer pixels are native ARGB8888 words */
+#define SCREEN_RGB(r, g, b) (0xFF000000u | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b))
+
 struct screen_s;
 
+typedef void (*screen_overlay_f)(struct screen_s *screen);
+
 bool screen_global_init();
 void screen_global_shutdown();
 
@@ -18,7 +25,20 @@ uint16_t screen_get_width(struct screen_s *screen);
 uint16_t screen_get_height(struct screen_s *screen);
 void screen_clear(struct screen_s *screen);
 void screen_draw_pixel(struct screen_s *screen, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b);
+void screen_draw_rect(struct screen_s *screen, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t r, uint8_t g, uint8_t b);
+void screen_set_framebuffer(struct screen_s *screen, const uint32_t *framebuffer);
+/* how the framebuffer is scaled to the window, false when the filter can't be used at this scale */
+bool screen_set_filter(struct screen_s *screen, enum scale_filter_e filter);
+/* drawn over the framebuffer on every present, which then always happens, NULL to remove it */
+void screen_set_overlay(struct screen_s *screen, screen_overlay_f overlay);
+/* off by default, a vsynced screen blocks every present until the display refreshes */
+void screen_set_vsync(struct screen_s *screen, bool vsync);
+/* of the display the window is on, 0 when unknown */
+float screen_refresh_rate(struct screen_s *screen);
 void screen_print(struct screen_s *screen, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b, char *msg);
-void screen_present(struct screen_s *screen);
+/* the next present happens even if the framebuffer didn't change, after the window was exposed for instance */
+void screen_invalidate(struct screen_s *screen);
+/* true when the present waited for the vertical sync, which then paced the frame */
+bool screen_present(struct screen_s *screen);
 
 #endif
\ No newline at end of file
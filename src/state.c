@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "state.h"
+#include "cpu.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "ppu.h"
+#include "input.h"
+
+#define STATE_MAGIC "VGES"
+
+#define ROM_GLOBAL_CHECKSUM_ADDR 0x014E
+
+struct state_header_s {
+    char magic[4];
+    uint32_t version;
+    uint32_t size; // whole state, header included
+    uint16_t rom_checksum;
+    uint16_t reserved;
+};
+
+static uint16_t state_rom_checksum() {
+    return (memory_read_8(ROM_GLOBAL_CHECKSUM_ADDR) << 8) | memory_read_8(ROM_GLOBAL_CHECKSUM_ADDR + 1);
+}
+
+size_t state_size() {
+    return sizeof(struct state_header_s) + cpu_state_size() + memory_state_size() + interrupt_state_size() + timer_state_size() + ppu_state_size() + input_state_size();
+}
+
+void state_save(uint8_t *buffer) {
+    struct state_header_s header = {
+        .magic = STATE_MAGIC,
+        .version = STATE_VERSION,
+        .size = state_size(),
+        .rom_checksum = state_rom_checksum(),
+        .reserved = 0
+    };
+    memcpy(buffer, &header, sizeof(header));
+    buffer += sizeof(header);
+
+    cpu_state_save(buffer);
+    buffer += cpu_state_size();
+    memory_state_save(buffer);
+    buffer += memory_state_size();
+    interrupt_state_save(buffer);
+    buffer += interrupt_state_size();
+    timer_state_save(buffer);
+    buffer += timer_state_size();
+    ppu_state_save(buffer);
+    buffer += ppu_state_size();
+    input_state_save(buffer);
+}
+
+bool state_load(const uint8_t *buffer) {
+    struct state_header_s header;
+    memcpy(&header, buffer, sizeof(header));
+
+    if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic))) {
+        LOG_MESG(LOG_WARN, "Not a save state");
+        return false;
+    }
+
+    if (header.version != STATE_VERSION || header.size != state_size()) {
+        LOG_MESG(LOG_WARN, "Unsupported save state version %"PRIu32" (size %"PRIu32"), expected version %d (size %zu)", header.version, header.size, STATE_VERSION, state_size());
+        return false;
+    }
+
+    if (header.rom_checksum != state_rom_checksum()) {
+        LOG_MESG(LOG_WARN, "Save state was made with another rom (checksum 0x%04X)", header.rom_checksum);
+        return false;
+    }
+
+    buffer += sizeof(header);
+
+    cpu_state_load(buffer);
+    buffer += cpu_state_size();
+    memory_state_load(buffer);
+    buffer += memory_state_size();
+    interrupt_state_load(buffer);
+    buffer += interrupt_state_size();
+    timer_state_load(buffer);
+    buffer += timer_state_size();
+    ppu_state_load(buffer);
+    buffer += ppu_state_size();
+    input_state_load(buffer);
+
+    return true;
+}
+
+bool state_save_file(const char *path) {
+    const size_t size = state_size();
+    uint8_t *buffer = malloc(size);
+    if (!buffer) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    state_save(buffer);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        free(buffer);
+        return false;
+    }
+
+    const bool written = fwrite(buffer, 1, size, f) == size;
+    fclose(f);
+    free(buffer);
+
+    if (!written) {
+        LOG_MESG(LOG_WARN, "Couldn't write save state to %s", path);
+        return false;
+    }
+
+    LOG_MESG(LOG_INFO, "State saved to %s", path);
+    return true;
+}
+
+bool state_load_file(const char *path) {
+    const size_t size = state_size();
+    uint8_t *buffer = malloc(size);
+    if (!buffer) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        LOG_MESG(LOG_WARN, "Couldn't open file %s", path);
+        free(buffer);
+        return false;
+    }
+
+    const size_t nr_read = fread(buffer, 1, size, f);
+    fclose(f);
+
+    if (nr_read != size) {
+        LOG_MESG(LOG_WARN, "Save state %s is truncated (nr read: %zu)", path, nr_read);
+        free(buffer);
+        return false;
+    }
+
+    const bool loaded = state_load(buffer);
+    free(buffer);
+
+    if (loaded)
+        LOG_MESG(LOG_INFO, "State loaded from %s", path);
+    return loaded;
+}
\ No newline at end of file
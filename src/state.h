@@ -0,0 +1,16 @@
+#ifndef STATE
+#define STATE
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define STATE_VERSION 5
+
+size_t state_size();
+void state_save(uint8_t *buffer);
+bool state_load(const uint8_t *buffer);
+
+bool state_save_file(const char *path);
+bool state_load_file(const char *path);
+
+#endif
\ No newline at end of file
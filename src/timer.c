@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <string.h>
 
 #include "log.h"
 
@@ -9,12 +10,18 @@
 #define TIMER_DIV_HERTZ_CLOCK 16'384
 #define TIMER_DIV_MACHINE_CLOCK (TIMER_DIV_HERTZ_CLOCK / 4)
 
+struct timer_s {
+    uint64_t div_m_cycles_ellapsed;
+    uint64_t tima_m_cycles_ellapsed;
+};
+
+static struct timer_s timer = { 0 };
+
 static void timer_div(uint8_t m_cycles) {
-    static uint64_t m_cycles_ellapsed = 0;
-    m_cycles_ellapsed += m_cycles;
+    timer.div_m_cycles_ellapsed += m_cycles;
 
-    if (m_cycles_ellapsed >= TIMER_DIV_MACHINE_CLOCK) {
-        m_cycles_ellapsed -= TIMER_DIV_MACHINE_CLOCK;
+    if (timer.div_m_cycles_ellapsed >= TIMER_DIV_MACHINE_CLOCK) {
+        timer.div_m_cycles_ellapsed -= TIMER_DIV_MACHINE_CLOCK;
         memory_write_8(TIMER_DIV_MEMORY_ADDR, memory_read_8(TIMER_DIV_MEMORY_ADDR) + 1);
     }
 }
@@ -43,36 +50,34 @@ static bool timer_inc_tima() {
 }
 
 static bool timer_tima(uint8_t m_cycles) {
-    static uint64_t m_cycles_ellapsed = 0;
-
     if (!(memory_read_8(TIMER_TAC_MEMORY_ADDR) & TIMER_TAC_TIMA_ENABLE))
         return false;
 
-    m_cycles_ellapsed += m_cycles;
+    timer.tima_m_cycles_ellapsed += m_cycles;
 
     uint8_t clock_select = memory_read_8(TIMER_TAC_MEMORY_ADDR) & TIMER_TAC_CLOCK_SELECT;
     switch (clock_select) {
         case 0x00:
-            if (m_cycles_ellapsed >= TIMER_TIMA_00_MACHINE_CLOCK) {
-                m_cycles_ellapsed -= TIMER_TIMA_00_MACHINE_CLOCK;
+            if (timer.tima_m_cycles_ellapsed >= TIMER_TIMA_00_MACHINE_CLOCK) {
+                timer.tima_m_cycles_ellapsed -= TIMER_TIMA_00_MACHINE_CLOCK;
                 return timer_inc_tima();
             }
             return false;
         case 0b01:
-            if (m_cycles_ellapsed >= TIMER_TIMA_01_MACHINE_CLOCK) {
-                m_cycles_ellapsed -= TIMER_TIMA_01_MACHINE_CLOCK;
+            if (timer.tima_m_cycles_ellapsed >= TIMER_TIMA_01_MACHINE_CLOCK) {
+                timer.tima_m_cycles_ellapsed -= TIMER_TIMA_01_MACHINE_CLOCK;
                 return timer_inc_tima();
             }
             return false;
         case 0b10:
-            if (m_cycles_ellapsed >= TIMER_TIMA_10_MACHINE_CLOCK) {
-                m_cycles_ellapsed -= TIMER_TIMA_10_MACHINE_CLOCK;
+            if (timer.tima_m_cycles_ellapsed >= TIMER_TIMA_10_MACHINE_CLOCK) {
+                timer.tima_m_cycles_ellapsed -= TIMER_TIMA_10_MACHINE_CLOCK;
                 return timer_inc_tima();
             }
             return false;
         case 0b11:
-            if (m_cycles_ellapsed >= TIMER_TIMA_11_MACHINE_CLOCK) {
-                m_cycles_ellapsed -= TIMER_TIMA_11_MACHINE_CLOCK;
+            if (timer.tima_m_cycles_ellapsed >= TIMER_TIMA_11_MACHINE_CLOCK) {
+                timer.tima_m_cycles_ellapsed -= TIMER_TIMA_11_MACHINE_CLOCK;
                 return timer_inc_tima();
             }
             return false;
@@ -84,4 +89,16 @@ static bool timer_tima(uint8_t m_cycles) {
 bool timer_run(uint8_t m_cycles) {
     timer_div(m_cycles);
     return timer_tima(m_cycles);
+}
+
+size_t timer_state_size() {
+    return sizeof(struct timer_s);
+}
+
+void timer_state_save(uint8_t *buffer) {
+    memcpy(buffer, &timer, sizeof(struct timer_s));
+}
+
+void timer_state_load(const uint8_t *buffer) {
+    memcpy(&timer, buffer, sizeof(struct timer_s));
 }
\ No newline at end of file
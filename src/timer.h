@@ -1,6 +1,13 @@
 #ifndef TIMER
 #define TIMER
 
+#include <inttypes.h>
+#include <stddef.h>
+
 bool timer_run(uint8_t m_cycles);
 
-#endif
+size_t timer_state_size();
+void timer_state_save(uint8_t *buffer);
+void timer_state_load(const uint8_t *buffer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL3/SDL.h>
+
+#include "log.h"
+
+#include "viewer.h"
+#include "memory.h"
+#include "ppu.h"
+#include "input.h"
+
+#define VIEWER_INTERVAL_NS (100 * 1'000'000) // refresh at most 10 times per second
+
+#define VRAM_SIZE 0x2000
+#define TILE_COUNT 384
+#define TILE_SIZE 16
+#define TILE_MAP_0 0x1800 // offset of 0x9800 in the vram
+#define SCY_ADDR 0xFF42
+#define SCX_ADDR 0xFF43
+
+#define GAP_COLOR SCREEN_RGB(0x00, 0x00, 0x00)
+#define VIEWPORT_COLOR SCREEN_RGB(0xFF, 0x00, 0x00)
+
+struct viewer_s {
+    struct screen_s *tiles_screen;
+    struct screen_s *map_screen;
+
+    SDL_Thread *thread;
+    SDL_Mutex *mutex;
+    SDL_Condition *wake;
+    bool exposed; // a window showed up again, the images have to be presented again
+    bool busy; // the thread owns everything below
+    bool drawn; // the images are new and not presented yet
+    bool quit;
+
+    uint64_t generation; // vram generation of the snapshot
+    uint8_t scx;
+    uint8_t scy;
+    uint64_t snapshot_ns;
+
+    uint8_t vram[VRAM_SIZE];
+    uint32_t shades[4];
+    uint32_t tiles[VIEWER_TILES_HEIGHT][VIEWER_TILES_WIDTH];
+    uint32_t map[VIEWER_MAP_SIZE][VIEWER_MAP_SIZE];
+};
+
+static struct viewer_s *viewer = NULL;
+
+static void tile_blit(uint16_t index, uint32_t *dst, size_t pitch) {
+    const uint8_t *data = viewer->vram + index * TILE_SIZE;
+    for (uint8_t y = 0; y < 8; y++, dst += pitch)
+        for (uint8_t x = 0; x < 8; x++)
+            dst[x] = viewer->shades[((data[y * 2] >> (7 - x)) & 0x01) | (((data[y * 2 + 1] >> (7 - x)) & 0x01) << 1)];
+}
+
+static void viewer_draw() {
+    for (uint16_t y = 0; y < VIEWER_TILES_HEIGHT; y++)
+        for (uint16_t x = 0; x < VIEWER_TILES_WIDTH; x++)
+            viewer->tiles[y][x] = GAP_COLOR;
+    for (uint16_t i = 0; i < TILE_COUNT; i++)
+        tile_blit(i, &viewer->tiles[(i / 16) * 9][(i % 16) * 9], VIEWER_TILES_WIDTH);
+
+    // the map as the unsigned tile addressing shows it
+    for (uint8_t i = 0; i < 32; i++)
+        for (uint8_t j = 0; j < 32; j++)
+            tile_blit(viewer->vram[TILE_MAP_0 + i * 32 + j], &viewer->map[i * 8][j * 8], VIEWER_MAP_SIZE);
+
+    // dotted outline of the screen, wrapping around the map
+    for (uint8_t i = 0; i < 160; i += 8) {
+        viewer->map[viewer->scy][(uint8_t)(viewer->scx + i)] = VIEWPORT_COLOR;
+        viewer->map[(uint8_t)(viewer->scy + 144)][(uint8_t)(viewer->scx + i)] = VIEWPORT_COLOR;
+    }
+    for (uint8_t i = 0; i < 144; i += 8) {
+        viewer->map[(uint8_t)(viewer->scy + i)][viewer->scx] = VIEWPORT_COLOR;
+        viewer->map[(uint8_t)(viewer->scy + i)][(uint8_t)(viewer->scx + 160)] = VIEWPORT_COLOR;
+    }
+}
+
+static int viewer_thread(void *data) {
+    (void)data;
+
+    SDL_LockMutex(viewer->mutex);
+    while (true) {
+        while (!viewer->busy && !viewer->quit)
+            SDL_WaitCondition(viewer->wake, viewer->mutex);
+        if (viewer->quit)
+            break;
+
+        SDL_UnlockMutex(viewer->mutex);
+        viewer_draw();
+        SDL_LockMutex(viewer->mutex);
+
+        viewer->busy = false;
+        viewer->drawn = true;
+    }
+    SDL_UnlockMutex(viewer->mutex);
+
+    return 0;
+}
+
+bool viewer_init(struct screen_s *tiles_screen, struct screen_s *map_screen) {
+    viewer = calloc(1, sizeof(struct viewer_s));
+    if (!viewer) {
+        LOG_MESG(LOG_WARN, "Couldn't malloc");
+        return false;
+    }
+
+    viewer->tiles_screen = tiles_screen;
+    viewer->map_screen = map_screen;
+    viewer->generation = UINT64_MAX;
+
+    viewer->mutex = SDL_CreateMutex();
+    viewer->wake = SDL_CreateCondition();
+    if (viewer->mutex && viewer->wake)
+        viewer->thread = SDL_CreateThread(viewer_thread, "debug viewers", NULL);
+
+    if (!viewer->thread) {
+        LOG_MESG(LOG_WARN, "Couldn't start the viewer thread: %s", SDL_GetError());
+        viewer_shutdown();
+        return false;
+    }
+
+    screen_set_framebuffer(tiles_screen, &viewer->tiles[0][0]);
+    screen_set_framebuffer(map_screen, &viewer->map[0][0]);
+
+    return true;
+}
+
+void viewer_shutdown() {
+    if (!viewer)
+        return;
+
+    if (viewer->thread) {
+        SDL_LockMutex(viewer->mutex);
+        viewer->quit = true;
+        SDL_SignalCondition(viewer->wake);
+        SDL_UnlockMutex(viewer->mutex);
+        SDL_WaitThread(viewer->thread, NULL);
+    }
+
+    if (viewer->wake)
+        SDL_DestroyCondition(viewer->wake);
+    if (viewer->mutex)
+        SDL_DestroyMutex(viewer->mutex);
+    free(viewer);
+    viewer = NULL;
+}
+
+void viewer_update() {
+    if (!viewer)
+        return;
+
+    // the windows keep nothing while occluded or minimized
+    if (input_window_exposed())
+        viewer->exposed = true;
+
+    SDL_LockMutex(viewer->mutex);
+    const bool busy = viewer->busy;
+    const bool drawn = viewer->drawn;
+    viewer->drawn = false;
+    SDL_UnlockMutex(viewer->mutex);
+
+    if (busy)
+        return;
+
+    if (drawn || viewer->exposed) {
+        if (viewer->exposed) {
+            screen_invalidate(viewer->tiles_screen);
+            screen_invalidate(viewer->map_screen);
+            viewer->exposed = false;
+        }
+        screen_present(viewer->tiles_screen);
+        screen_present(viewer->map_screen);
+    }
+
+    const uint64_t now_ns = SDL_GetTicksNS();
+    const uint64_t generation = ppu_vram_generation();
+    const uint8_t scx = memory_read_8(SCX_ADDR);
+    const uint8_t scy = memory_read_8(SCY_ADDR);
+    if (now_ns - viewer->snapshot_ns < VIEWER_INTERVAL_NS)
+        return;
+    if (generation == viewer->generation && scx == viewer->scx && scy == viewer->scy)
+        return;
+
+    viewer->snapshot_ns = now_ns;
+    viewer->generation = generation;
+    viewer->scx = scx;
+    viewer->scy = scy;
+    memcpy(viewer->vram, memory_special_get_vram(), VRAM_SIZE);
+    memcpy(viewer->shades, ppu_get_shades(), sizeof(viewer->shades));
+
+    SDL_LockMutex(viewer->mutex);
+    viewer->busy = true;
+    SDL_SignalCondition(viewer->wake);
+    SDL_UnlockMutex(viewer->mutex);
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef VIEWER
+#define VIEWER
+
+#include <inttypes.h>
+
+#include "screen.h"
+
+/* the 384 tiles, 16 per row with a 1 pixel gap, and the 32x32 tiles of the first map */
+#define VIEWER_TILES_WIDTH (9 * 16)
+#define VIEWER_TILES_HEIGHT (9 * (384 / 16))
+#define VIEWER_MAP_SIZE 256
+
+/* draws into both screens from their own thread, presented from viewer_update() */
+bool viewer_init(struct screen_s *tiles_screen, struct screen_s *map_screen);
+void viewer_shutdown();
+
+/* once per frame from the main thread: presents what was drawn, and snapshots the vram when it changed */
+void viewer_update();
+
+#endif
\ No newline at end of file
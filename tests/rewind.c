@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+#include "state.h"
+
+/* the emulator state is faked by a plain buffer, so only the ring itself is exercised */
+
+#define TEST_STATE_SIZE 4096
+#define TEST_CAPACITY (16 * 1024) // small enough to wrap every few dozen frames
+#define TEST_FRAMES 2000
+
+static uint8_t state[TEST_STATE_SIZE];
+static uint8_t history[TEST_FRAMES][TEST_STATE_SIZE];
+
+size_t state_size() {
+    return TEST_STATE_SIZE;
+}
+
+void state_save(uint8_t *buffer) {
+    memcpy(buffer, state, TEST_STATE_SIZE);
+}
+
+bool state_load(const uint8_t *buffer) {
+    memcpy(state, buffer, TEST_STATE_SIZE);
+    return true;
+}
+
+/* changes a varying number of bytes so the deltas don't all have the same size */
+static void mutate(size_t frame) {
+    const size_t changes = (frame * 7919) % 600;
+    for (size_t i = 0; i < changes; i++)
+        state[rand() % TEST_STATE_SIZE] = (uint8_t)rand();
+}
+
+int main() {
+    srand(1);
+
+    if (!rewind_init(TEST_CAPACITY)) {
+        fprintf(stderr, "rewind_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t pushed = 0;
+    size_t popped_total = 0;
+    size_t frame = 0;
+    while (pushed < TEST_FRAMES) {
+        // push a batch wrapping the ring several times, then rewind part of it
+        const size_t batch = 50 + rand() % 150;
+        for (size_t i = 0; i < batch && pushed < TEST_FRAMES; i++) {
+            mutate(frame++);
+            memcpy(history[pushed++], state, TEST_STATE_SIZE);
+            rewind_push();
+        }
+
+        const size_t pops = rand() % 40;
+        for (size_t i = 0; i < pops && pushed > 1; i++) {
+            if (!rewind_pop())
+                break;
+
+            // rewind_pop restores the previous state, then the current one is pushed again from there
+            pushed--;
+            if (memcmp(state, history[pushed - 1], TEST_STATE_SIZE)) {
+                fprintf(stderr, "frame %zu restored wrongly\n", pushed - 1);
+                rewind_shutdown();
+                return EXIT_FAILURE;
+            }
+            popped_total++;
+        }
+    }
+
+    rewind_shutdown();
+    printf("rewind: %zu frames pushed, %zu popped and checked\n", frame, popped_total);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file